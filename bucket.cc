@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <cstring>
+
+#include "boltdb/boltdb.h"
+#include "wal.h"
+
+namespace boltdb {
+
+Bucket::Bucket(Tx* tx, const dBucket& hdr, Page* inline_page,
+               const Comparator* cmp)
+    : tx_(tx),
+      hdr_(hdr),
+      page_(inline_page),
+      cmp_(cmp != nullptr ? cmp : BytewiseComparator()) {}
+
+Page* Bucket::rootPage() {
+  // Inline buckets have a single leaf page stored in their value.
+  if (this->hdr_.root == 0) {
+    return this->page_;
+  }
+  return this->tx_->page(this->hdr_.root);
+}
+
+uint16_t Bucket::childIndex(Page* branch, const Slice& key) {
+  bool exact = false;
+  uint16_t index = branch->SearchBranch(key, this->cmp_, &exact);
+  // If we didn't find an exact match then the key lives in the previous
+  // child.
+  if (!exact && index > 0) {
+    index--;
+  }
+  return index;
+}
+
+Status Bucket::getFromLeaf(Page* leaf, const Slice& key, Slice* value) {
+  bool exact = false;
+  uint16_t index = leaf->SearchLeaf(key, this->cmp_, &exact);
+  if (!exact) {
+    return Status::NotFound();
+  }
+  LeafPageElement* e = leaf->GetLeafPageElementAt(index);
+  // Return NotFound if this is a bucket.
+  if (e->flags & kBucketLeafFlag) {
+    return Status::NotFound();
+  }
+  *value = e->value();
+  return Status::OK();
+}
+
+bool Bucket::getFromWal(const Slice& key, Slice* value, Status* s) {
+  WriteAheadLog* wal = this->tx_->db_->wal_;
+  if (wal == nullptr) {
+    return false;
+  }
+  std::string logged;
+  bool deleted = false;
+  Status found = wal->Get(this->name_, std::string(key.data(), key.size()),
+                          this->tx_->ID(), &logged, &deleted);
+  if (!found.ok()) {
+    return false;
+  }
+  if (deleted) {
+    *s = Status::NotFound();
+    return true;
+  }
+  this->tx_->logged_values_.push_back(std::move(logged));
+  const std::string& v = this->tx_->logged_values_.back();
+  *value = Slice(v.data(), v.size());
+  *s = Status::OK();
+  return true;
+}
+
+Status Bucket::Get(const Slice& key, Slice* value) {
+  Status s;
+  if (this->getFromWal(key, value, &s)) {
+    return s;
+  }
+  Page* p = this->rootPage();
+  while (p != nullptr && (p->flags & kPageFlagBranch)) {
+    uint16_t index = this->childIndex(p, key);
+    p = this->tx_->page(p->GetBranchPageElementAt(index)->pgid);
+  }
+  if (p == nullptr) {
+    return Status::IOError();
+  }
+  return this->getFromLeaf(p, key, value);
+}
+
+void Bucket::MultiGet(const std::vector<Slice>& keys,
+                      std::vector<Slice>* values,
+                      std::vector<Status>* statuses) {
+  values->assign(keys.size(), Slice());
+  statuses->assign(keys.size(), Status::NotFound());
+
+  // Keys decided by the write-ahead log never touch the tree.
+  std::vector<size_t> order;
+  order.reserve(keys.size());
+  for (size_t k = 0; k < keys.size(); k++) {
+    if (!this->getFromWal(keys[k], &(*values)[k], &(*statuses)[k])) {
+      order.push_back(k);
+    }
+  }
+  if (order.empty()) {
+    return;
+  }
+  std::sort(order.begin(), order.end(), [&keys, this](size_t a, size_t b) {
+    return this->cmp_->Compare(keys[a], keys[b]) < 0;
+  });
+
+  // pages[i] is the page the i-th sorted key has reached, or null once a
+  // page on its path could not be read. The tree is balanced, so all keys
+  // reach the leaf level together.
+  std::vector<Page*> pages(order.size(), this->rootPage());
+  std::vector<pgid_t> children(order.size());
+  while (true) {
+    auto live = std::find_if(pages.begin(), pages.end(),
+                             [](Page* p) { return p != nullptr; });
+    if (live == pages.end() || !((*live)->flags & kPageFlagBranch)) {
+      break;
+    }
+    Page* prev_page = nullptr;
+    uint16_t prev_index = 0;
+    pgid_t prev_child = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+      Page* p = pages[i];
+      if (p == nullptr) {
+        continue;
+      }
+      const Slice& key = keys[order[i]];
+      // Sorted neighbours routed through the same page usually follow the
+      // same child; only search again once the key passed the next separator.
+      uint16_t index;
+      if (p == prev_page &&
+          (prev_index + 1 == p->count ||
+           this->cmp_->Compare(
+               key, p->GetBranchPageElementAt(prev_index + 1)->key()) < 0)) {
+        index = prev_index;
+      } else {
+        index = this->childIndex(p, key);
+      }
+      children[i] = p->GetBranchPageElementAt(index)->pgid;
+      if (children[i] != prev_child) {
+        this->tx_->prefetch(children[i]);
+        prev_child = children[i];
+      }
+      prev_page = p;
+      prev_index = index;
+    }
+
+    // Only now touch the next level.
+    for (size_t i = 0; i < order.size(); i++) {
+      if (pages[i] != nullptr) {
+        pages[i] = this->tx_->page(children[i]);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < order.size(); i++) {
+    size_t k = order[i];
+    if (pages[i] == nullptr) {
+      (*statuses)[k] = Status::IOError();
+      continue;
+    }
+    (*statuses)[k] = this->getFromLeaf(pages[i], keys[k], &(*values)[k]);
+  }
+}
+
+Status Bucket::DeleteRange(const Slice& begin, const Slice& end) {
+  if (!this->tx_->Writable()) {
+    return Status::Invalid();
+  }
+  if (this->cmp_->Compare(begin, end) >= 0) {
+    return Status::OK();
+  }
+
+  pgids_t covered, freed;
+  Page* root = this->rootPage();
+  if (root == nullptr) {
+    return Status::IOError();
+  }
+  uint16_t left = 0;
+  Status s =
+      this->deleteRange(root, begin, end, nullptr, &covered, &freed, &left);
+  if (s.ok()) {
+    s = this->collect(std::move(covered), &freed);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  if (left == 0) {
+    // The root page stays in place, emptied down to a leaf.
+    std::vector<bool> keep(root->count, false);
+    this->rewrite(root, keep)->flags = kPageFlagLeaf;
+  }
+  this->tx_->free(freed);
+  return Status::OK();
+}
+
+Status Bucket::deleteRange(Page* p, const Slice& begin, const Slice& end,
+                           const Slice* upper, pgids_t* covered,
+                           pgids_t* freed, uint16_t* remaining) {
+  std::vector<bool> keep(p->count, true);
+  uint16_t left = p->count;
+  if (p->flags & kPageFlagLeaf) {
+    for (uint16_t i = 0; i < p->count; i++) {
+      LeafPageElement* e = p->GetLeafPageElementAt(i);
+      Slice key = e->key();
+      if (this->cmp_->Compare(key, begin) >= 0 &&
+          this->cmp_->Compare(key, end) < 0) {
+        // A nested bucket goes with its key, pages and all.
+        pgid_t root = nestedRoot(e);
+        if (root != 0) {
+          covered->push_back(root);
+        }
+        keep[i] = false;
+        left--;
+      }
+    }
+  } else {
+    for (uint16_t i = 0; i < p->count; i++) {
+      // Child i holds keys in [key(i), key(i+1)); the last child is bounded
+      // by the parent's bound instead. A separator is never above the first
+      // key of its child, so key(i) is a valid lower bound.
+      BranchPageElement* e = p->GetBranchPageElementAt(i);
+      Slice lower = e->key();
+      Slice next;
+      const Slice* child_upper = upper;
+      if (i + 1 < p->count) {
+        next = p->GetBranchPageElementAt(i + 1)->key();
+        child_upper = &next;
+      }
+      if (this->cmp_->Compare(lower, end) >= 0 ||
+          (child_upper != nullptr &&
+           this->cmp_->Compare(*child_upper, begin) <= 0)) {
+        continue;
+      }
+
+      // Detach subtrees that lie inside the range without descending.
+      if (this->cmp_->Compare(lower, begin) >= 0 && child_upper != nullptr &&
+          this->cmp_->Compare(*child_upper, end) <= 0) {
+        covered->push_back(e->pgid);
+        keep[i] = false;
+        left--;
+        continue;
+      }
+
+      Page* child = this->tx_->page(e->pgid);
+      if (child == nullptr) {
+        return Status::IOError();
+      }
+      uint16_t child_left = 0;
+      Status s = this->deleteRange(child, begin, end, child_upper, covered,
+                                   freed, &child_left);
+      if (!s.ok()) {
+        return s;
+      }
+      if (child_left == 0) {
+        for (pgid_t id = child->id; id <= child->id + child->overflow; id++) {
+          freed->push_back(id);
+        }
+        keep[i] = false;
+        left--;
+      }
+    }
+  }
+
+  if (left > 0 && left < p->count) {
+    this->rewrite(p, keep);
+  }
+  *remaining = left;
+  return Status::OK();
+}
+
+pgid_t Bucket::nestedRoot(LeafPageElement* e) {
+  if (!(e->flags & kBucketLeafFlag) || e->vsize < kBucketHeaderSize) {
+    return 0;
+  }
+  // Inline buckets live in the value and own no pages.
+  dBucket hdr;
+  memcpy(&hdr, e->value().data(), sizeof(hdr));
+  return hdr.root;
+}
+
+Status Bucket::collect(pgids_t roots, pgids_t* ids) {
+  // Walk level by level so that the reads of a level overlap. Leaves are
+  // only scanned for nested buckets, whose trees are walked as well.
+  while (!roots.empty()) {
+    for (pgid_t id : roots) {
+      this->tx_->prefetch(id);
+    }
+    pgids_t next;
+    for (pgid_t id : roots) {
+      Page* p = this->tx_->acquire(id);
+      if (p == nullptr) {
+        return Status::IOError();
+      }
+      for (pgid_t i = id; i <= id + p->overflow; i++) {
+        ids->push_back(i);
+      }
+      if (p->flags & kPageFlagBranch) {
+        for (uint16_t i = 0; i < p->count; i++) {
+          next.push_back(p->GetBranchPageElementAt(i)->pgid);
+        }
+      } else if (p->flags & kPageFlagLeaf) {
+        for (uint16_t i = 0; i < p->count; i++) {
+          pgid_t root = nestedRoot(p->GetLeafPageElementAt(i));
+          if (root != 0) {
+            next.push_back(root);
+          }
+        }
+      }
+      this->tx_->release(id);
+    }
+    roots.swap(next);
+  }
+  return Status::OK();
+}
+
+Page* Bucket::rewrite(Page* p, const std::vector<bool>& keep) {
+  bool branch = p->flags & kPageFlagBranch;
+  size_t esize = branch ? sizeof(BranchPageElement) : sizeof(LeafPageElement);
+  uint16_t count = std::count(keep.begin(), keep.end(), true);
+  size_t size = kPageHeaderSize + count * esize;
+  for (uint16_t i = 0; i < p->count; i++) {
+    if (keep[i] && branch) {
+      size += p->GetBranchPageElementAt(i)->ksize;
+    } else if (keep[i]) {
+      LeafPageElement* e = p->GetLeafPageElementAt(i);
+      size += e->ksize + e->vsize;
+    }
+  }
+  // Pages of the tree keep their full size; an inline page is sized to its
+  // contents.
+  if (this->hdr_.root != 0) {
+    size = std::max(size, size_t(p->overflow + 1) * this->tx_->db_->page_size_);
+  }
+
+  char* buf = new char[size]();
+  auto* np = reinterpret_cast<Page*>(buf);
+  np->id = p->id;
+  np->flags = p->flags;
+  np->count = count;
+  np->overflow = p->overflow;
+  char* kv = np->data + count * esize;
+  uint16_t j = 0;
+  for (uint16_t i = 0; i < p->count; i++) {
+    if (!keep[i]) {
+      continue;
+    }
+    // Element positions are relative to the element itself.
+    if (branch) {
+      BranchPageElement* src = p->GetBranchPageElementAt(i);
+      BranchPageElement* dst = np->GetBranchPageElementAt(j++);
+      *dst = *src;
+      dst->pos = uint32_t(kv - reinterpret_cast<char*>(dst));
+      memcpy(kv, src->key().data(), src->ksize);
+      kv += src->ksize;
+    } else {
+      LeafPageElement* src = p->GetLeafPageElementAt(i);
+      LeafPageElement* dst = np->GetLeafPageElementAt(j++);
+      *dst = *src;
+      dst->pos = uint32_t(kv - reinterpret_cast<char*>(dst));
+      memcpy(kv, src->key().data(), src->ksize + src->vsize);
+      kv += src->ksize + src->vsize;
+    }
+  }
+
+  if (this->hdr_.root == 0) {
+    this->inline_copy_.reset(buf);
+    this->page_ = np;
+  } else {
+    this->tx_->dirty(np->id, buf);
+  }
+  return np;
+}
+
+}  // namespace boltdb
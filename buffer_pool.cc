@@ -0,0 +1,312 @@
+#include "buffer_pool.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace boltdb {
+
+// O_DIRECT requires buffers, offsets and lengths aligned to the logical block
+// size; the OS page size covers every common device.
+static const size_t kDirectAlign = 4096;
+
+BufferPool::PageRef& BufferPool::PageRef::operator=(PageRef&& other) {
+  if (this != &other) {
+    Release();
+    pool_ = other.pool_;
+    frame_ = other.frame_;
+    other.pool_ = nullptr;
+    other.frame_ = nullptr;
+  }
+  return *this;
+}
+
+void BufferPool::PageRef::Release() {
+  if (frame_ != nullptr) {
+    pool_->unpin(frame_);
+    pool_ = nullptr;
+    frame_ = nullptr;
+  }
+}
+
+BufferPool::BufferPool(int fd, uint32_t page_size, size_t capacity)
+    : fd_(fd),
+      page_size_(page_size),
+      capacity_(capacity),
+      used_(0),
+      hand_(0),
+      closing_(false) {}
+
+BufferPool::~BufferPool() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    closing_ = true;
+  }
+  io_cv_.notify_all();
+  for (auto& t : io_threads_) {
+    t.join();
+  }
+  for (Frame* f : clock_) {
+    free(f->buf);
+    delete f;
+  }
+  ::close(fd_);
+}
+
+Status BufferPool::Open(const std::string& path, uint32_t page_size,
+                        size_t capacity, bool direct, int io_threads,
+                        BufferPool** poolptr) {
+  int fd = -1;
+#ifdef O_DIRECT
+  // O_DIRECT reads must be block aligned, which page reads only are when
+  // the page size is a multiple of the alignment.
+  if (direct && page_size % kDirectAlign == 0) {
+    fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+  }
+#endif
+  // Some filesystems (tmpfs for one) reject O_DIRECT; fall back to buffered
+  // reads rather than failing.
+  if (fd < 0) {
+    fd = ::open(path.c_str(), O_RDONLY);
+  }
+  if (fd < 0) {
+    return Status::IOError();
+  }
+  if (capacity < page_size) {
+    ::close(fd);
+    return Status::Invalid();
+  }
+
+  auto* pool = new BufferPool(fd, page_size, capacity);
+  for (int i = 0; i < io_threads; i++) {
+    pool->io_threads_.emplace_back(&BufferPool::ioLoop, pool);
+  }
+  *poolptr = pool;
+  return Status::OK();
+}
+
+char* BufferPool::alignedAlloc(size_t size) {
+  void* p = nullptr;
+  size_t rounded = (size + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+  if (posix_memalign(&p, kDirectAlign, rounded) != 0) {
+    return nullptr;
+  }
+  return static_cast<char*>(p);
+}
+
+bool BufferPool::reserve(size_t size) {
+  // Sweep at most twice around the clock: the first pass may only clear
+  // reference bits.
+  size_t steps = clock_.size() * 2;
+  while (used_ + size > capacity_ && steps-- > 0 && !clock_.empty()) {
+    if (hand_ >= clock_.size()) {
+      hand_ = 0;
+    }
+    Frame* f = clock_[hand_];
+    if (f->pins > 0) {
+      hand_++;
+      continue;
+    }
+    if (f->ref) {
+      f->ref = false;
+      hand_++;
+      continue;
+    }
+
+    // Evict; the last frame takes the slot so the hand stays in place.
+    table_.erase(f->id);
+    used_ -= f->size;
+    clock_[hand_] = clock_.back();
+    clock_.pop_back();
+    free(f->buf);
+    delete f;
+  }
+  return used_ + size <= capacity_;
+}
+
+BufferPool::Frame* BufferPool::allocate(pgid_t id, bool force) {
+  if (!reserve(page_size_) && !force) {
+    return nullptr;
+  }
+  char* buf = alignedAlloc(page_size_);
+  if (buf == nullptr) {
+    return nullptr;
+  }
+  Frame* f = new Frame{id, buf, page_size_, 1, true, true, false};
+  used_ += f->size;
+  table_[id] = f;
+  clock_.push_back(f);
+  return f;
+}
+
+void BufferPool::load(Frame* f) {
+  off_t offset = off_t(f->id) * page_size_;
+  bool ok = ::pread(fd_, f->buf, page_size_, offset) == ssize_t(page_size_);
+
+  // Pages with overflow span several consecutive pages; read the whole run.
+  // The overflow count comes from disk, so a run past the end of the file
+  // fails the read instead of sizing the frame.
+  uint32_t overflow = ok ? reinterpret_cast<Page*>(f->buf)->overflow : 0;
+  if (ok && overflow > 0) {
+    uint64_t size = (uint64_t(overflow) + 1) * page_size_;
+    struct stat st;
+    ok = ::fstat(fd_, &st) == 0 &&
+         uint64_t(offset) + size <= uint64_t(st.st_size);
+  }
+  if (ok && overflow > 0) {
+    size_t size = (size_t(overflow) + 1) * page_size_;
+    char* buf = nullptr;
+    {
+      // The caller already holds a pin on the page, so growing the frame may
+      // go over budget if nothing else can be evicted.
+      std::lock_guard<std::mutex> lock(mu_);
+      reserve(size - f->size);
+      buf = alignedAlloc(size);
+      if (buf != nullptr) {
+        used_ += size - f->size;
+      }
+    }
+    ok = buf != nullptr && ::pread(fd_, buf, size, offset) == ssize_t(size);
+    std::lock_guard<std::mutex> lock(mu_);
+    // The extra bytes were already accounted for by reserve.
+    if (buf != nullptr) {
+      free(f->buf);
+      f->buf = buf;
+      f->size = size;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  f->loading = false;
+  f->failed = !ok;
+  loaded_cv_.notify_all();
+}
+
+void BufferPool::unpin(Frame* f) {
+  std::lock_guard<std::mutex> lock(mu_);
+  f->pins--;
+  // A failed read is dropped as soon as nobody waits on it, so a later fetch
+  // retries.
+  if (f->failed && f->pins == 0) {
+    for (size_t i = 0; i < clock_.size(); i++) {
+      if (clock_[i] == f) {
+        clock_[i] = clock_.back();
+        clock_.pop_back();
+        break;
+      }
+    }
+    table_.erase(f->id);
+    used_ -= f->size;
+    free(f->buf);
+    delete f;
+  }
+}
+
+BufferPool::Frame* BufferPool::pin(pgid_t id, bool force,
+                                    std::unique_lock<std::mutex>* lock) {
+  Frame* f;
+  auto it = table_.find(id);
+  if (it != table_.end()) {
+    f = it->second;
+    f->pins++;
+    f->ref = true;
+    loaded_cv_.wait(*lock, [f] { return !f->loading; });
+  } else {
+    f = allocate(id, force);
+    if (f == nullptr) {
+      return nullptr;
+    }
+    lock->unlock();
+    load(f);
+    lock->lock();
+  }
+  return f;
+}
+
+Status BufferPool::Fetch(pgid_t id, PageRef* ref) {
+  std::unique_lock<std::mutex> lock(mu_);
+  Frame* f = pin(id, false, &lock);
+  if (f == nullptr) {
+    return Status::Busy();
+  }
+
+  PageRef handle;
+  handle.pool_ = this;
+  handle.frame_ = f;
+  bool failed = f->failed;
+  lock.unlock();
+  if (failed) {
+    return Status::IOError();
+  }
+  *ref = std::move(handle);
+  return Status::OK();
+}
+
+Page* BufferPool::Pin(pgid_t id) {
+  std::unique_lock<std::mutex> lock(mu_);
+  Frame* f = pin(id, true, &lock);
+  if (f == nullptr) {
+    return nullptr;
+  }
+  bool failed = f->failed;
+  lock.unlock();
+  if (failed) {
+    unpin(f);
+    return nullptr;
+  }
+  return reinterpret_cast<Page*>(f->buf);
+}
+
+void BufferPool::Unpin(pgid_t id) {
+  Frame* f;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = table_.find(id);
+    if (it == table_.end()) {
+      return;
+    }
+    f = it->second;
+  }
+  unpin(f);
+}
+
+void BufferPool::Prefetch(pgid_t id) {
+  std::unique_lock<std::mutex> lock(mu_);
+  if (io_threads_.empty() || table_.count(id) != 0) {
+    return;
+  }
+  // The I/O thread owns the pin until the read completes.
+  Frame* f = allocate(id, false);
+  if (f == nullptr) {
+    return;
+  }
+  io_queue_.push_back(f);
+  lock.unlock();
+  io_cv_.notify_one();
+}
+
+void BufferPool::ioLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    io_cv_.wait(lock, [this] { return closing_ || !io_queue_.empty(); });
+    if (io_queue_.empty()) {
+      return;
+    }
+    Frame* f = io_queue_.front();
+    io_queue_.pop_front();
+    lock.unlock();
+    load(f);
+    unpin(f);
+    lock.lock();
+  }
+}
+
+size_t BufferPool::Resident() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return used_;
+}
+
+}  // namespace boltdb
@@ -0,0 +1,126 @@
+#ifndef __BOLTDB_BUFFER_POOL_H__
+#define __BOLTDB_BUFFER_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+
+namespace boltdb {
+
+/**
+ * @brief BufferPool caches pages of the data file in user space under a fixed
+ * memory budget, as the alternative to mapping the whole file.
+ *
+ * Pages are read with pread (through O_DIRECT when asked and supported, so
+ * the kernel page cache is bypassed) into aligned frames. A frame stays
+ * resident while it is pinned by a PageRef; unpinned frames are evicted in
+ * CLOCK order when the budget is exhausted. Misses can be started ahead of
+ * time with Prefetch, which hands the read to a small pool of I/O threads.
+ */
+class BufferPool : public noncopyable {
+ private:
+  struct Frame {
+    pgid_t id;
+    char* buf;
+    size_t size;
+    int pins;
+    bool ref;
+    bool loading;
+    bool failed;
+  };
+
+ public:
+  // PageRef is a pinned handle on a resident page. The page stays valid until
+  // the handle is released or destroyed.
+  class PageRef {
+   public:
+    PageRef() : pool_(nullptr), frame_(nullptr) {}
+    PageRef(PageRef&& other) : pool_(other.pool_), frame_(other.frame_) {
+      other.pool_ = nullptr;
+      other.frame_ = nullptr;
+    }
+    PageRef& operator=(PageRef&& other);
+    PageRef(const PageRef&) = delete;
+    PageRef& operator=(const PageRef&) = delete;
+    ~PageRef() { Release(); }
+
+    Page* get() const { return reinterpret_cast<Page*>(frame_->buf); }
+    Page* operator->() const { return get(); }
+    explicit operator bool() const { return frame_ != nullptr; }
+    void Release();
+
+   private:
+    friend class BufferPool;
+    BufferPool* pool_;
+    Frame* frame_;
+  };
+
+  ~BufferPool();
+
+  // Open opens path for page reads. capacity is the memory budget in bytes.
+  // direct asks for O_DIRECT reads; buffered reads are used instead when
+  // page_size is not a multiple of 4KB or the filesystem refuses O_DIRECT.
+  static Status Open(const std::string& path, uint32_t page_size,
+                     size_t capacity, bool direct, int io_threads,
+                     BufferPool** poolptr);
+
+  // Fetch pins the page with the given id, reading it (and its overflow
+  // pages) on a miss. Returns Busy if every frame in the budget is pinned.
+  Status Fetch(pgid_t id, PageRef* ref);
+
+  // Pin pins a page for a caller that tracks pins by pgid, such as a
+  // transaction. Unlike Fetch it never fails for lack of frames: when every
+  // frame is pinned the budget is exceeded until pins are released. Returns
+  // nullptr if the page could not be read.
+  Page* Pin(pgid_t id);
+  void Unpin(pgid_t id);
+
+  // Prefetch starts reading a page in the background if it is not resident.
+  void Prefetch(pgid_t id);
+
+  // Resident returns the number of bytes held by frames.
+  size_t Resident() const;
+
+ private:
+  BufferPool(int fd, uint32_t page_size, size_t capacity);
+  // reserve makes room for size more bytes by evicting unpinned frames.
+  // mu_ must be held.
+  bool reserve(size_t size);
+  // allocate inserts a pinned, loading frame for id, going over budget when
+  // force is set. mu_ must be held.
+  Frame* allocate(pgid_t id, bool force);
+  // pin returns the pinned, loaded frame for id. mu_ must be held by lock.
+  Frame* pin(pgid_t id, bool force, std::unique_lock<std::mutex>* lock);
+  // load reads the frame contents without holding mu_.
+  void load(Frame* frame);
+  void unpin(Frame* frame);
+  char* alignedAlloc(size_t size);
+  void ioLoop();
+
+ private:
+  int fd_;
+  uint32_t page_size_;
+  size_t capacity_;
+  size_t used_;
+
+  mutable std::mutex mu_;
+  std::condition_variable loaded_cv_;
+  std::unordered_map<pgid_t, Frame*> table_;
+  std::vector<Frame*> clock_;
+  size_t hand_;
+
+  std::condition_variable io_cv_;
+  std::deque<Frame*> io_queue_;
+  std::vector<std::thread> io_threads_;
+  bool closing_;
+};
+
+}  // namespace boltdb
+
+#endif
@@ -0,0 +1,361 @@
+#include "check.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace boltdb {
+
+PageBitmap::PageBitmap(pgid_t n)
+    : words_(new std::atomic<uint64_t>[(n + 63) / 64]()) {}
+
+bool PageBitmap::Mark(pgid_t id) {
+  uint64_t bit = uint64_t(1) << (id % 64);
+  return words_[id / 64].fetch_or(bit, std::memory_order_relaxed) & bit;
+}
+
+bool PageBitmap::Test(pgid_t id) const {
+  uint64_t bit = uint64_t(1) << (id % 64);
+  return words_[id / 64].load(std::memory_order_relaxed) & bit;
+}
+
+static std::string format(const char* fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+static std::string format(const char* fmt, ...) {
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  return std::string(buf);
+}
+
+Checker::Checker(page_fn_t page_fn, uint32_t page_size, pgid_t high_water,
+                 const FreeList* freelist)
+    : page_fn_(std::move(page_fn)),
+      page_size_(page_size),
+      high_water_(high_water),
+      freelist_(freelist),
+      check_leaks_(true),
+      comparators_(nullptr),
+      reachable_(high_water),
+      active_(0),
+      errors_(0) {}
+
+void Checker::Reserve(pgid_t id, uint32_t overflow) {
+  for (pgid_t i = id; i <= id + overflow && i < high_water_; i++) {
+    reachable_.Mark(i);
+  }
+}
+
+Status Checker::Run(pgid_t root, int workers, const error_fn_t& on_error) {
+  on_error_ = on_error;
+  if (workers <= 0) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  push(Task{root, "", "", false, BytewiseComparator(), true});
+  std::vector<std::thread> threads;
+  for (int i = 0; i < workers; i++) {
+    threads.emplace_back(&Checker::worker, this);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // Every page below the high water mark must be reachable or freed.
+  for (pgid_t id = 0; check_leaks_ && id < high_water_; id++) {
+    if (!reachable_.Test(id) &&
+        (freelist_ == nullptr || !freelist_->Freed(id))) {
+      report(format("page %lu: unreachable unfreed", id));
+    }
+  }
+  return errors_ == 0 ? Status::OK() : Status::Corruption();
+}
+
+pgids_t Checker::Unreachable() const {
+  pgids_t ids;
+  for (pgid_t id = 0; id < high_water_; id++) {
+    if (!reachable_.Test(id)) {
+      ids.push_back(id);
+    }
+  }
+  return ids;
+}
+
+void Checker::push(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    queue_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void Checker::worker() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    cv_.wait(lock, [this] { return !queue_.empty() || active_ == 0; });
+    if (queue_.empty()) {
+      // Nothing queued and nobody left to produce more work.
+      cv_.notify_all();
+      return;
+    }
+    Task task = std::move(queue_.front());
+    queue_.pop_front();
+    active_++;
+    lock.unlock();
+
+    walk(task);
+
+    lock.lock();
+    active_--;
+    if (active_ == 0 && queue_.empty()) {
+      cv_.notify_all();
+    }
+  }
+}
+
+void Checker::report(const std::string& msg) {
+  errors_++;
+  std::lock_guard<std::mutex> lock(error_mu_);
+  on_error_(msg);
+}
+
+void Checker::walk(const Task& task) {
+  pgid_t id = task.pgid;
+  if (id < 2 || id >= high_water_) {
+    report(format("page %lu: out of bounds: %lu", id, high_water_));
+    return;
+  }
+
+  Page* p = page_fn_(id);
+  if (p == nullptr) {
+    // The page is referenced; don't report it as leaked as well.
+    reachable_.Mark(id);
+    report(format("page %lu: unreadable", id));
+    return;
+  }
+  checkPage(p, task);
+  if (release_fn_) {
+    release_fn_(id);
+  }
+}
+
+void Checker::checkPage(Page* p, const Task& task) {
+  pgid_t id = task.pgid;
+  if (p->id != id) {
+    report(format("page %lu: header has id %lu", id, p->id));
+    return;
+  }
+  if (id + p->overflow >= high_water_) {
+    report(format("page %lu: overflow %u out of bounds: %lu", id, p->overflow,
+                  high_water_));
+    return;
+  }
+
+  // Ensure each page is only referenced once and is not on the freelist.
+  for (pgid_t i = id; i <= id + p->overflow; i++) {
+    if (reachable_.Mark(i)) {
+      report(format("page %lu: multiple references", i));
+      return;
+    }
+    if (freelist_ != nullptr && freelist_->Freed(i)) {
+      report(format("page %lu: reachable freed", i));
+    }
+  }
+
+  if (!(p->flags & (kPageFlagBranch | kPageFlagLeaf))) {
+    report(format("page %lu: invalid type: %s", id, p->Type().c_str()));
+    return;
+  }
+  const char* end = reinterpret_cast<const char*>(p) +
+                    uint64_t(page_size_) * (uint64_t(p->overflow) + 1);
+  checkElements(p, end, task);
+}
+
+// checkElements verifies a branch or leaf page (which may be an inline
+// bucket page ending at end) and queues its children.
+void Checker::checkElements(Page* p, const char* end, const Task& task) {
+  const char* base = reinterpret_cast<const char*>(p);
+  bool branch = p->flags & kPageFlagBranch;
+  size_t elemsz =
+      branch ? sizeof(BranchPageElement) : sizeof(LeafPageElement);
+  if (kPageHeaderSize + p->count * elemsz > size_t(end - base)) {
+    report(format("page %lu: %u elements overflow the page", task.pgid,
+                  p->count));
+    return;
+  }
+  if (branch && p->count == 0) {
+    report(format("page %lu: empty branch", task.pgid));
+    return;
+  }
+
+  Slice prev;
+  for (uint16_t i = 0; i < p->count; i++) {
+    Slice key, value;
+    if (branch) {
+      BranchPageElement* e = p->GetBranchPageElementAt(i);
+      const char* data = reinterpret_cast<const char*>(e) + e->pos;
+      if (data < base || data + e->ksize > end) {
+        report(format("page %lu: element %u out of bounds", task.pgid, i));
+        return;
+      }
+      key = e->key();
+    } else {
+      LeafPageElement* e = p->GetLeafPageElementAt(i);
+      const char* data = reinterpret_cast<const char*>(e) + e->pos;
+      if (data < base || data + uint64_t(e->ksize) + e->vsize > end) {
+        report(format("page %lu: element %u out of bounds", task.pgid, i));
+        return;
+      }
+      key = e->key();
+      value = e->value();
+    }
+
+    if (i == 0) {
+      if (!task.lower.empty() && task.cmp->Compare(key, task.lower) < 0) {
+        report(format("page %lu: first key below parent branch key",
+                      task.pgid));
+      }
+    } else if (task.cmp->Compare(prev, key) >= 0) {
+      report(format("page %lu: element %u out of order", task.pgid, i));
+    }
+    if (task.has_upper && task.cmp->Compare(key, task.upper) >= 0) {
+      report(format("page %lu: element %u beyond next branch key", task.pgid,
+                    i));
+    }
+    prev = key;
+
+    if (branch) {
+      Task child{p->GetBranchPageElementAt(i)->pgid,
+                 std::string(key.data(), key.size()),
+                 "",
+                 task.has_upper,
+                 task.cmp,
+                 task.root_bucket};
+      if (i + 1 < p->count) {
+        Slice next = p->GetBranchPageElementAt(i + 1)->key();
+        child.upper.assign(next.data(), next.size());
+        child.has_upper = true;
+      } else {
+        child.upper = task.upper;
+      }
+      push(std::move(child));
+    } else if (p->GetLeafPageElementAt(i)->flags & kBucketLeafFlag) {
+      checkBucketValue(key, value, task);
+    }
+  }
+}
+
+void Checker::checkBucketValue(Slice key, Slice value, const Task& task) {
+  if (value.size() < kBucketHeaderSize) {
+    report(format("page %lu: bucket header truncated", task.pgid));
+    return;
+  }
+  dBucket hdr;
+  memcpy(&hdr, value.data(), sizeof(hdr));
+
+  // Only top-level buckets carry a configured ordering; nested buckets use
+  // the default one.
+  const Comparator* cmp = BytewiseComparator();
+  if (task.root_bucket && comparators_ != nullptr) {
+    auto it = comparators_->find(std::string(key.data(), key.size()));
+    if (it != comparators_->end()) {
+      cmp = it->second;
+    }
+  }
+
+  if (hdr.root != 0) {
+    push(Task{hdr.root, "", "", false, cmp, false});
+    return;
+  }
+
+  // Inline buckets store their single leaf page right after the header and
+  // own no pgids.
+  const char* data = value.data() + kBucketHeaderSize;
+  const char* end = value.data() + value.size();
+  if (size_t(end - data) < kPageHeaderSize) {
+    report(format("page %lu: inline bucket truncated", task.pgid));
+    return;
+  }
+  Page* inline_page = reinterpret_cast<Page*>(const_cast<char*>(data));
+  if (!(inline_page->flags & kPageFlagLeaf)) {
+    report(format("page %lu: inline bucket is not a leaf", task.pgid));
+    return;
+  }
+  checkElements(inline_page, end, Task{task.pgid, "", "", false, cmp, false});
+}
+
+bool FreelistPageValid(Page* p, pgid_t id, uint32_t page_size,
+                       pgid_t high_water) {
+  if (!(p->flags & kPageFlagFreeList) || id + p->overflow >= high_water) {
+    return false;
+  }
+  uint64_t size = uint64_t(page_size) * (uint64_t(p->overflow) + 1);
+  uint64_t count = p->count;
+  if (count == 0xFFFF) {
+    if (size < kPageHeaderSize + sizeof(pgid_t)) {
+      return false;
+    }
+    count = reinterpret_cast<const pgid_t*>(p->data)[0] + 1;
+  }
+  return count <= (size - kPageHeaderSize) / sizeof(pgid_t);
+}
+
+Status Tx::Check(const std::function<void(const std::string&)>& on_error,
+                 int workers) {
+  // The free pages must match the snapshot being checked. The live
+  // freelist also holds pages freed by a writer after this tx started (and
+  // is mutated by that writer meanwhile), so readers use the freelist page
+  // written with their meta page instead. A writer owns the live freelist,
+  // including its own pending frees.
+  FreeList snapshot(FreeListType::FreeListArray);
+  const FreeList* freelist = this->writable_ ? this->db_->freelist_ : nullptr;
+
+  // Meta pages and the freelist page are referenced from outside the trees.
+  bool bad = false;
+  uint32_t freelist_overflow = 0;
+  if (this->meta_->freelist != 0 &&
+      this->meta_->freelist != kPgidNoFreelist) {
+    Page* p = this->page(this->meta_->freelist);
+    if (p == nullptr) {
+      on_error("page " + std::to_string(this->meta_->freelist) +
+               ": unreadable");
+      bad = true;
+    } else if (!FreelistPageValid(p, this->meta_->freelist,
+                                  this->db_->page_size_, this->meta_->pgid)) {
+      on_error("page " + std::to_string(this->meta_->freelist) +
+               ": invalid freelist page");
+      bad = true;
+    } else {
+      freelist_overflow = p->overflow;
+      if (!this->writable_) {
+        // The page stays mapped (or pinned) for the life of the tx.
+        snapshot.Read(p, false);
+        freelist = &snapshot;
+      }
+    }
+  }
+
+  Checker checker([this](pgid_t id) { return this->acquire(id); },
+                  this->db_->page_size_, this->meta_->pgid, freelist);
+  checker.SetRelease([this](pgid_t id) { this->release(id); });
+  checker.SetComparators(&this->db_->comparators_);
+  // Without a usable freelist (none synced, or a bad page already reported)
+  // a reader cannot tell free pages from leaked ones.
+  checker.SetCheckLeaks(freelist != nullptr);
+  checker.Reserve(0, 0);
+  checker.Reserve(1, 0);
+  if (this->meta_->freelist != 0 &&
+      this->meta_->freelist != kPgidNoFreelist) {
+    checker.Reserve(this->meta_->freelist, freelist_overflow);
+  }
+  Status s = checker.Run(this->meta_->root.root, workers, on_error);
+  return bad ? Status::Corruption() : s;
+}
+
+}  // namespace boltdb
@@ -0,0 +1,121 @@
+#ifndef __BOLTDB_CHECK_H__
+#define __BOLTDB_CHECK_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "boltdb/boltdb.h"
+
+namespace boltdb {
+
+// PageBitmap is a fixed size set of pgids that can be marked concurrently.
+class PageBitmap {
+ public:
+  explicit PageBitmap(pgid_t n);
+
+  // Mark sets the bit for id and returns whether it was already set.
+  bool Mark(pgid_t id);
+  bool Test(pgid_t id) const;
+
+ private:
+  std::unique_ptr<std::atomic<uint64_t>[]> words_;
+};
+
+/**
+ * @brief Checker walks every bucket tree reachable from a root page and
+ * validates it, using a pool of workers that each take one subtree at a time.
+ *
+ * It verifies that every page is in bounds, of the expected type, referenced
+ * exactly once and not on the freelist, that the elements of each page lie
+ * inside the page and are strictly ordered within the key range given by
+ * the parent branch, and finally that every page below the high water mark
+ * is either reachable or freed.
+ */
+class Checker : public noncopyable {
+ public:
+  using page_fn_t = std::function<Page*(pgid_t)>;
+  using release_fn_t = std::function<void(pgid_t)>;
+  using error_fn_t = std::function<void(const std::string&)>;
+
+  Checker(page_fn_t page_fn, uint32_t page_size, pgid_t high_water,
+          const FreeList* freelist);
+
+  // comparators maps top-level bucket names to their key ordering.
+  void SetComparators(
+      const std::unordered_map<std::string, const Comparator*>* comparators) {
+    comparators_ = comparators;
+  }
+
+  // release is called with each page id returned by page_fn once the
+  // checker is done with the page.
+  void SetRelease(release_fn_t release) { release_fn_ = std::move(release); }
+
+  // SetCheckLeaks turns the final pass that reports pages that are neither
+  // reachable nor freed on or off (it is on by default). It has to be off
+  // when the free pages are unknown.
+  void SetCheckLeaks(bool check) { check_leaks_ = check; }
+
+  // Reserve marks pages that are reachable outside the bucket trees, such as
+  // the meta pages and the freelist page.
+  void Reserve(pgid_t id, uint32_t overflow);
+
+  // Run walks the tree rooted at root. Errors are reported through on_error
+  // (serialized, never concurrently) and Corruption is returned if any.
+  Status Run(pgid_t root, int workers, const error_fn_t& on_error);
+
+  // Unreachable returns the pages below the high water mark that Run did not
+  // reach, in ascending order.
+  pgids_t Unreachable() const;
+
+ private:
+  struct Task {
+    pgid_t pgid;
+    std::string lower;
+    std::string upper;
+    bool has_upper;
+    const Comparator* cmp;
+    bool root_bucket;
+  };
+
+  void worker();
+  void walk(const Task& task);
+  void checkPage(Page* p, const Task& task);
+  void checkElements(Page* p, const char* end, const Task& task);
+  void checkBucketValue(Slice key, Slice value, const Task& task);
+  void report(const std::string& msg);
+  void push(Task task);
+
+ private:
+  page_fn_t page_fn_;
+  release_fn_t release_fn_;
+  uint32_t page_size_;
+  pgid_t high_water_;
+  const FreeList* freelist_;
+  bool check_leaks_;
+  const std::unordered_map<std::string, const Comparator*>* comparators_;
+  PageBitmap reachable_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<Task> queue_;
+  int active_;
+
+  std::mutex error_mu_;
+  error_fn_t on_error_;
+  std::atomic<int> errors_;
+};
+
+// FreelistPageValid reports whether p, read as page id, is a freelist page
+// below high_water whose ids fit in the page.
+bool FreelistPageValid(Page* p, pgid_t id, uint32_t page_size,
+                       pgid_t high_water);
+
+}  // namespace boltdb
+
+#endif
@@ -0,0 +1,41 @@
+#include "boltdb/comparator.h"
+
+namespace boltdb {
+
+namespace {
+template <typename Policy>
+class BuiltinComparator : public Comparator {
+ public:
+  explicit BuiltinComparator(const char* name) : name_(name) {}
+
+  int Compare(const Slice& a, const Slice& b) const override {
+    return Policy::Compare(a, b);
+  }
+
+  const char* Name() const override { return name_; }
+
+ private:
+  const char* name_;
+};
+}  // namespace
+
+const Comparator* BytewiseComparator() {
+  static BuiltinComparator<BytewiseCompare> cmp("boltdb.BytewiseComparator");
+  return &cmp;
+}
+
+const Comparator* BigEndianU64Comparator() {
+  static BuiltinComparator<BigEndianCompare<uint64_t>> cmp(
+      "boltdb.BigEndianU64Comparator");
+  return &cmp;
+}
+
+#if defined(__SIZEOF_INT128__)
+const Comparator* BigEndianU128Comparator() {
+  static BuiltinComparator<BigEndianCompare<unsigned __int128>> cmp(
+      "boltdb.BigEndianU128Comparator");
+  return &cmp;
+}
+#endif
+
+}  // namespace boltdb
\ No newline at end of file
@@ -1,3 +1,540 @@
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include <cerrno>
+#include <vector>
+
 #include "boltdb/boltdb.h"
+#include "boltdb/fsync.h"
+#include "buffer_pool.h"
+#include "check.h"
+
+namespace boltdb {
+
+Options Options::Default() {
+  Options opts;
+  opts.timeout = std::chrono::milliseconds(0);
+  opts.noGrowSync = false;
+  opts.noFreeListSync = false;
+  opts.freeListType = FreeListType::FreeListArray;
+  opts.readOnly = false;
+  opts.mmapFlags = 0;
+  opts.initialMmapSize = 0;
+  opts.pageSize = 0;
+  opts.noSync = false;
+  opts.mlock = false;
+  opts.replica = false;
+  opts.replicaPollInterval = std::chrono::milliseconds(100);
+  opts.ioBackend = IOBackend::Mmap;
+  opts.bufferPoolSize = 256 << 20;
+  opts.directIO = true;
+  opts.ioThreads = 4;
+  return opts;
+}
+
+DB::DB()
+    : fd_(-1),
+      page_size_(0),
+      data_(nullptr),
+      datasz_(0),
+      meta0_(nullptr),
+      meta1_(nullptr),
+      metas_(),
+      pool_(nullptr),
+      wal_(nullptr),
+      freelist_(nullptr),
+      replica_meta_(),
+      closing_(false) {}
+
+DB::~DB() { this->Close(); }
+
+// flock acquires an advisory lock on the file descriptor, retrying until
+// timeout (forever if it is zero).
+static Status flock(int fd, bool exclusive,
+                    std::chrono::milliseconds timeout) {
+  auto start = std::chrono::steady_clock::now();
+  int how = (exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB;
+  while (::flock(fd, how) != 0) {
+    if (errno != EWOULDBLOCK) {
+      return Status::IOError();
+    }
+    if (timeout.count() > 0 &&
+        std::chrono::steady_clock::now() - start > timeout) {
+      return Status::IOError();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return Status::OK();
+}
+
+Status DB::Open(const std::string& path, Options& opts, DB** dbptr) {
+  DB* db = new DB();
+  db->path_ = path;
+  db->opts_ = opts;
+  db->comparators_ = opts.comparators;
+
+  int flags = db->IsReadOnly() ? O_RDONLY : (O_RDWR | O_CREAT);
+  db->fd_ = ::open(path.c_str(), flags, 0666);
+  if (db->fd_ < 0) {
+    delete db;
+    return Status::IOError();
+  }
+
+  // Lock file so that other processes using Bolt in read-write mode cannot
+  // use the database at the same time. This would cause corruption since the
+  // two processes would write meta pages and free pages separately. Replicas
+  // skip the lock since they exist to follow a live writer.
+  Status s;
+  if (!opts.replica) {
+    s = flock(db->fd_, !opts.readOnly, opts.timeout);
+  }
+
+  // Default values for test hooks.
+  db->page_size_ = opts.pageSize > 0 ? opts.pageSize : ::getpagesize();
+
+  // Initialize the database if it doesn't exist.
+  struct stat st;
+  if (s.ok() && ::fstat(db->fd_, &st) != 0) {
+    s = Status::IOError();
+  }
+  if (s.ok() && st.st_size == 0) {
+    s = db->IsReadOnly() ? Status::Invalid() : db->init();
+  } else if (s.ok()) {
+    // Read the first meta page to determine the page size.
+    char buf[0x1000];
+    if (::pread(db->fd_, buf, sizeof(buf), 0) >=
+        ssize_t(kPageHeaderSize + sizeof(Meta))) {
+      Meta* m = reinterpret_cast<Page*>(buf)->AsMeta();
+      // If we can't read the page size, we can assume it's the same as the
+      // OS -- since that's how the page size was chosen in the first place.
+      if (m->Validate().ok()) {
+        db->page_size_ = m->page_size;
+      }
+    }
+  }
+
+  // Memory map the data file, or set up the buffer pool instead.
+  if (s.ok() && opts.ioBackend == IOBackend::BufferPool) {
+    s = opts.replica ? Status::Invalid() : db->openBufferPool();
+  } else if (s.ok()) {
+    s = db->mmap(opts.initialMmapSize);
+  }
+  if (!s.ok()) {
+    delete db;
+    return s;
+  }
+
+  if (opts.replica) {
+    db->meta()->Copy(&db->replica_meta_);
+    db->watcher_ = std::thread(&DB::watch, db);
+  }
+
+  // Only writers need the freelist. Reading it (or rebuilding it when it was
+  // not synced) is proportional to the file size, so it happens in the
+  // background and read transactions can start right away.
+  if (!db->IsReadOnly()) {
+    db->freelist_ready_ =
+        std::async(std::launch::async, [db] { return db->loadFreelist(); })
+            .share();
+  }
+  *dbptr = db;
+  return Status::OK();
+}
+
+Status DB::Begin(bool writable, Tx** txptr) {
+  if (writable) {
+    if (this->IsReadOnly()) {
+      return Status::Invalid();
+    }
+    // Writers allocate and free pages, so they need the freelist.
+    Status s = this->waitFreelist();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  *txptr = new Tx(this, writable);
+  return Status::OK();
+}
+
+Status DB::Close() {
+  this->closing_ = true;
+  if (this->watcher_.joinable()) {
+    this->watcher_.join();
+  }
+  // The loader reads through the mapping and holds mmaplock_ while it runs.
+  this->waitFreelist();
+  this->freelist_ready_ = std::shared_future<Status>();
+  delete this->freelist_;
+  this->freelist_ = nullptr;
+
+  std::unique_lock<std::shared_timed_mutex> lock(this->mmaplock_);
+  delete this->pool_;
+  this->pool_ = nullptr;
+  Status s = this->munmap();
+  if (this->fd_ >= 0) {
+    // Closing the descriptor also releases the file lock.
+    ::close(this->fd_);
+    this->fd_ = -1;
+  }
+  return s;
+}
+
+// init creates a new database file and initializes its meta pages.
+Status DB::init() {
+  // Create two meta pages on a buffer.
+  std::vector<char> buf(this->page_size_ * 4, 0);
+  auto at = [&buf, this](pgid_t id) {
+    return reinterpret_cast<Page*>(&buf[id * this->page_size_]);
+  };
+  for (pgid_t i = 0; i < 2; i++) {
+    Meta m{};
+    m.magic = kMagic;
+    m.version = kVersion;
+    m.page_size = this->page_size_;
+    m.freelist = 2;
+    m.root.root = 3;
+    m.pgid = 4;
+    m.txid = i;
+    m.Write(at(i));
+  }
+
+  // Write an empty freelist at page 2.
+  Page* p = at(2);
+  p->id = 2;
+  p->flags = kPageFlagFreeList;
+  p->count = 0;
+
+  // Write an empty leaf page at page 3.
+  p = at(3);
+  p->id = 3;
+  p->flags = kPageFlagLeaf;
+  p->count = 0;
+
+  // Write the buffer to our data file.
+  if (::pwrite(this->fd_, buf.data(), buf.size(), 0) != ssize_t(buf.size())) {
+    return Status::IOError();
+  }
+  return fsync(this->fd_);
+}
+
+// mmap opens the underlying memory-mapped file and initializes the meta
+// references. minsz is the minimum size that the new mmap can be. The caller
+// must hold mmaplock_ exclusively (or be the only user of the DB).
+Status DB::mmap(int64_t minsz) {
+  struct stat st;
+  if (::fstat(this->fd_, &st) != 0) {
+    return Status::IOError();
+  }
+  if (st.st_size < this->page_size_ * 2) {
+    return Status::Invalid();
+  }
+
+  // Ensure the size is at least the minimum size.
+  int64_t size = st.st_size;
+  if (size < minsz) {
+    size = minsz;
+  }
+  Status s = this->mmapSize(size, &size);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Map the new region before dropping the old one, so that a failure
+  // leaves the existing mapping (and the meta references into it) intact.
+  int flags = MAP_SHARED | this->opts_.mmapFlags;
+  void* b = ::mmap(nullptr, size, PROT_READ, flags, this->fd_, 0);
+  if (b == MAP_FAILED) {
+    return Status::IOError();
+  }
+  // Advise the kernel that the mmap is accessed randomly.
+  ::madvise(b, size, MADV_RANDOM);
+
+  s = this->munmap();
+  if (!s.ok()) {
+    ::munmap(b, size);
+    return s;
+  }
+  this->data_ = static_cast<char*>(b);
+  this->datasz_ = size;
+
+  // Save references to the meta pages.
+  this->meta0_ = this->page(0)->AsMeta();
+  this->meta1_ = this->page(1)->AsMeta();
+
+  // Validate the meta pages. We only return an error if both meta pages fail
+  // validation, since meta0 failing validation means that it wasn't saved
+  // properly -- but we can recover using meta1. And vice-versa.
+  if (!this->meta0_->Validate().ok() && !this->meta1_->Validate().ok()) {
+    return Status::Invalid();
+  }
+  return Status::OK();
+}
+
+// openBufferPool sets up page access through the buffer pool. The meta pages
+// are read once and kept in the DB.
+Status DB::openBufferPool() {
+  Status s = BufferPool::Open(this->path_, this->page_size_,
+                              this->opts_.bufferPoolSize, this->opts_.directIO,
+                              this->opts_.ioThreads, &this->pool_);
+  if (!s.ok()) {
+    return s;
+  }
+  for (pgid_t i = 0; i < 2; i++) {
+    BufferPool::PageRef ref;
+    s = this->pool_->Fetch(i, &ref);
+    if (!s.ok()) {
+      return s;
+    }
+    ref->AsMeta()->Copy(&this->metas_[i]);
+  }
+  this->meta0_ = &this->metas_[0];
+  this->meta1_ = &this->metas_[1];
+  if (!this->meta0_->Validate().ok() && !this->meta1_->Validate().ok()) {
+    return Status::Invalid();
+  }
+  return Status::OK();
+}
+
+Status DB::munmap() {
+  if (this->data_ == nullptr) {
+    return Status::OK();
+  }
+  if (::munmap(this->data_, this->datasz_) != 0) {
+    return Status::IOError();
+  }
+  this->data_ = nullptr;
+  this->datasz_ = 0;
+  this->meta0_ = nullptr;
+  this->meta1_ = nullptr;
+  return Status::OK();
+}
+
+// mmapSize determines the appropriate size for the mmap given the current
+// size of the database. The minimum size is 32KB and doubles until it
+// reaches 1GB. Returns an error if the new mmap size is greater than the max
+// allowed.
+Status DB::mmapSize(int64_t size, int64_t* out) const {
+  // Double the size from 32KB until 1GB.
+  for (int i = 15; i <= 30; i++) {
+    if (size <= (int64_t(1) << i)) {
+      *out = int64_t(1) << i;
+      return Status::OK();
+    }
+  }
+
+  // Verify the requested size is not above the maximum allowed.
+  if (size > int64_t(BOLTDB_MAX_MMAP_SIZE)) {
+    return Status::Invalid();
+  }
+
+  // If larger than 1GB then grow by 1GB at a time.
+  int64_t sz = size;
+  int64_t remainder = sz % int64_t(kMaxMmapStep);
+  if (remainder > 0) {
+    sz += int64_t(kMaxMmapStep) - remainder;
+  }
+
+  // Ensure that the mmap size is a multiple of the page size.
+  // This should always be true since we're incrementing in MBs.
+  if (sz % this->page_size_ != 0) {
+    sz = ((sz / this->page_size_) + 1) * this->page_size_;
+  }
+
+  // If we've exceeded the max size then only grow up to the max size.
+  if (sz > int64_t(BOLTDB_MAX_MMAP_SIZE)) {
+    sz = BOLTDB_MAX_MMAP_SIZE;
+  }
+  *out = sz;
+  return Status::OK();
+}
+
+Page* DB::page(pgid_t id) {
+  uint64_t pos = id * uint64_t(this->page_size_);
+  return reinterpret_cast<Page*>(this->data_ + pos);
+}
+
+void DB::adviseWillNeed(pgid_t id, uint32_t pages) {
+  if (this->pool_ != nullptr) {
+    for (uint32_t i = 0; i < pages; i++) {
+      this->pool_->Prefetch(id + i);
+    }
+    return;
+  }
+  // The mmap is page aligned and so is page_size_, which is a multiple of
+  // the OS page size.
+  ::madvise(this->page(id), uint64_t(pages) * this->page_size_,
+            MADV_WILLNEED);
+}
+
+Meta* DB::meta() {
+  if (this->opts_.replica) {
+    return &this->replica_meta_;
+  }
+
+  // We have to return the meta with the highest txid which doesn't fail
+  // validation. Otherwise, we can cause errors when in fact the database is
+  // in a consistent state. metaA is the one with the higher txid.
+  Meta* metaA = this->meta0_;
+  Meta* metaB = this->meta1_;
+  if (this->meta1_->txid > this->meta0_->txid) {
+    metaA = this->meta1_;
+    metaB = this->meta0_;
+  }
+
+  // Use higher meta page if valid. Otherwise fallback to previous, if valid.
+  if (metaA->Validate().ok()) {
+    return metaA;
+  } else if (metaB->Validate().ok()) {
+    return metaB;
+  }
+  return nullptr;
+}
+
+// loadFreelist builds the freelist for the current meta page. Mapped
+// freelist pages are used in place; with the buffer pool the page is only
+// pinned for the duration of the load, so the ids are copied.
+Status DB::loadFreelist() {
+  Tx tx(this);
+  auto* freelist = new FreeList(this->opts_.freeListType);
+  const Meta* m = tx.meta_;
+  if (m->freelist == kPgidNoFreelist) {
+    // The freelist was not synced: every page that is not reachable from
+    // the root bucket is free.
+    Checker checker([&tx](pgid_t id) { return tx.acquire(id); },
+                    this->page_size_, m->pgid, nullptr);
+    checker.SetRelease([&tx](pgid_t id) { tx.release(id); });
+    checker.SetComparators(&this->comparators_);
+    checker.SetCheckLeaks(false);
+    checker.Reserve(0, 0);
+    checker.Reserve(1, 0);
+    // Pages below a broken branch would look free and later be reused
+    // while still live, so a damaged tree fails the load (and writers).
+    Status s = checker.Run(m->root.root, 0, [](const std::string&) {});
+    if (!s.ok()) {
+      delete freelist;
+      return s;
+    }
+    freelist->ReadIDs(checker.Unreachable());
+  } else {
+    Page* p = tx.page(m->freelist);
+    if (p == nullptr) {
+      delete freelist;
+      return Status::IOError();
+    }
+    if (!FreelistPageValid(p, m->freelist, this->page_size_, m->pgid)) {
+      delete freelist;
+      return Status::Corruption();
+    }
+    freelist->Read(p, this->pool_ != nullptr);
+  }
+  this->freelist_ = freelist;
+  return Status::OK();
+}
+
+Status DB::waitFreelist() {
+  if (!this->freelist_ready_.valid()) {
+    return Status::OK();
+  }
+  return this->freelist_ready_.get();
+}
+
+Status DB::Refresh() {
+  if (!this->opts_.replica) {
+    return Status::Invalid();
+  }
+
+  // Take stable copies of both meta pages; a meta page being rewritten by the
+  // writer right now fails its checksum and is skipped.
+  Meta m0, m1;
+  txid_t current;
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(this->mmaplock_);
+    this->meta0_->Copy(&m0);
+    this->meta1_->Copy(&m1);
+    current = this->replica_meta_.txid;
+  }
+  Meta* newest = nullptr;
+  if (m0.Validate().ok()) {
+    newest = &m0;
+  }
+  if (m1.Validate().ok() && (newest == nullptr || m1.txid > newest->txid)) {
+    newest = &m1;
+  }
+  if (newest == nullptr) {
+    return Status::Checksum();
+  }
+  if (newest->txid <= current) {
+    return Status::OK();
+  }
+
+  // Wait for open read transactions before remapping. A concurrent refresh
+  // may have published an even newer txid meanwhile.
+  std::unique_lock<std::shared_timed_mutex> lock(this->mmaplock_);
+  if (newest->txid <= this->replica_meta_.txid) {
+    return Status::OK();
+  }
+  int64_t minsz = int64_t(newest->pgid) * this->page_size_;
+  if (minsz > this->datasz_) {
+    Status s = this->mmap(minsz);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  newest->Copy(&this->replica_meta_);
+  return Status::OK();
+}
+
+// watch follows the writer in replica mode. It wakes up on every
+// modification of the file (inotify on Linux) or at least once per poll
+// interval, and refreshes the meta snapshot.
+void DB::watch() {
+  int interval = int(this->opts_.replicaPollInterval.count());
+  if (interval <= 0) {
+    interval = 100;
+  }
+  int ifd = -1;
+#if defined(__linux__)
+  ifd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (ifd >= 0 &&
+      ::inotify_add_watch(ifd, this->path_.c_str(), IN_MODIFY) < 0) {
+    ::close(ifd);
+    ifd = -1;
+  }
+#endif
+
+  while (!this->closing_) {
+#if defined(__linux__)
+    if (ifd >= 0) {
+      struct pollfd pfd = {ifd, POLLIN, 0};
+      if (::poll(&pfd, 1, interval) > 0) {
+        // Drain the events; one refresh covers all of them.
+        char buf[4096];
+        while (::read(ifd, buf, sizeof(buf)) > 0) {
+        }
+      }
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+    }
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+#endif
+    if (!this->closing_) {
+      // A failed refresh keeps the previous snapshot; retry on the next
+      // wake up.
+      (void)this->Refresh();
+    }
+  }
+
+  if (ifd >= 0) {
+    ::close(ifd);
+  }
+}
 
-namespace boltdb {}
\ No newline at end of file
+}  // namespace boltdb
@@ -1,8 +1,15 @@
+#include <algorithm>
+#include <cassert>
+
 #include "boltdb/boltdb.h"
 
 namespace boltdb {
 
-FreeList::FreeList(FreeListType typ) : freelist_type_(typ) {
+FreeList::FreeList(FreeListType typ)
+    : freelist_type_(typ),
+      mapped_ids_(nullptr),
+      mapped_count_(0),
+      pending_count_(0) {
   if (typ == FreeListType::FreeListHashMap) {
     this->allocate_fn_ = nullptr;
     this->free_count_fn_ = nullptr;
@@ -30,15 +37,200 @@ int FreeList::Count() {
 
 int FreeList::ArrayFreeCount() {
   // count of free pages (array version)
-  return this->ids_.size();
+  return this->ids_.size() + this->mapped_count_;
+}
+
+void FreeList::Free(txid_t txid, Page* p) {
+  assert(p->id > 1 && "cannot free page 0 or 1");
+
+  // Free page and all its overflow pages.
+  TxPending* txp = this->pendingFor(txid);
+  txid_t alloc_txid = 0;
+  auto it = this->allocs_.find(p->id);
+  if (it != this->allocs_.end()) {
+    alloc_txid = it->second;
+    this->allocs_.erase(it);
+  }
+
+  for (pgid_t id = p->id; id <= p->id + p->overflow; id++) {
+    // Verify that page is not already free.
+    assert(!this->Freed(id) && "page already freed");
+    // Add to the freelist and cache.
+    txp->ids_.push_back(id);
+    txp->alloc_txs_.push_back(alloc_txid);
+    this->cache_[id] = true;
+    this->pending_count_++;
+  }
+}
+
+void FreeList::Free(txid_t txid, const pgids_t& ids) {
+  if (ids.empty()) {
+    return;
+  }
+  TxPending* txp = this->pendingFor(txid);
+  txp->ids_.reserve(txp->ids_.size() + ids.size());
+  txp->alloc_txs_.reserve(txp->alloc_txs_.size() + ids.size());
+  for (pgid_t id : ids) {
+    assert(id > 1 && "cannot free page 0 or 1");
+    assert(!this->Freed(id) && "page already freed");
+    txid_t alloc_txid = 0;
+    auto it = this->allocs_.find(id);
+    if (it != this->allocs_.end()) {
+      alloc_txid = it->second;
+      this->allocs_.erase(it);
+    }
+    txp->ids_.push_back(id);
+    txp->alloc_txs_.push_back(alloc_txid);
+    this->cache_[id] = true;
+  }
+  this->pending_count_ += ids.size();
+}
+
+void FreeList::Release(txid_t txid) {
+  pgids_t released;
+  while (!this->pending_.empty() && this->pending_.front().txid_ <= txid) {
+    TxPending& txp = this->pending_.front();
+    released.insert(released.end(), txp.ids_.begin(), txp.ids_.end());
+    this->pending_count_ -= txp.ids_.size();
+    this->pending_.pop_front();
+  }
+  this->mergeReleased(released);
+}
+
+void FreeList::Rollback(txid_t txid) {
+  // Only the newest writer can be rolled back, so its pending entry (if any)
+  // is always at the back.
+  if (!this->pending_.empty() && this->pending_.back().txid_ == txid) {
+    TxPending& txp = this->pending_.back();
+    for (size_t i = 0; i < txp.ids_.size(); i++) {
+      pgid_t id = txp.ids_[i];
+      this->cache_.erase(id);
+      if (txp.alloc_txs_[i] != 0 && txp.alloc_txs_[i] != txid) {
+        // Page was allocated by an earlier committed tx; restore the record.
+        this->allocs_[id] = txp.alloc_txs_[i];
+      }
+    }
+    this->pending_count_ -= txp.ids_.size();
+    this->pending_.pop_back();
+  }
+
+  // Remove pages allocated by the rolled back tx.
+  for (auto it = this->allocs_.begin(); it != this->allocs_.end();) {
+    if (it->second == txid) {
+      it = this->allocs_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool FreeList::Freed(pgid_t pgid) const {
+  if (this->cache_.count(pgid) != 0) {
+    return true;
+  }
+  return std::binary_search(this->mapped_ids_,
+                            this->mapped_ids_ + this->mapped_count_, pgid);
+}
+
+pgids_t FreeList::FreeIDs() const {
+  if (this->mapped_count_ == 0) {
+    return this->ids_;
+  }
+  return pgids_t(this->mapped_ids_, this->mapped_ids_ + this->mapped_count_);
+}
+
+void FreeList::Read(Page* p, bool copy) {
+  assert((p->flags & kPageFlagFreeList) && "invalid freelist page");
+
+  // If the page.count is at the max uint16 value (64k) then it's considered
+  // an overflow and the size of the freelist is stored as the first element.
+  const pgid_t* ids = reinterpret_cast<const pgid_t*>(p->data);
+  size_t count = p->count;
+  if (count == 0xFFFF) {
+    count = ids[0];
+    ids++;
+  }
+
+  // Freelist pages are written sorted, which lets a large list be used
+  // straight from the page instead of being copied and hashed on open.
+  if (!copy && std::is_sorted(ids, ids + count)) {
+    this->ids_.clear();
+    this->mapped_ids_ = ids;
+    this->mapped_count_ = count;
+    this->reindex();
+    return;
+  }
+  this->ReadIDs(pgids_t(ids, ids + count));
+}
+
+void FreeList::ReadIDs(pgids_t ids) {
+  std::sort(ids.begin(), ids.end());
+  this->mapped_ids_ = nullptr;
+  this->mapped_count_ = 0;
+  this->ids_.swap(ids);
+  this->reindex();
+}
+
+void FreeList::reindex() {
+  // Rebuild the page cache: free pages plus all pending pages. Ids still in
+  // the freelist page are looked up there instead.
+  this->cache_.clear();
+  for (pgid_t id : this->ids_) {
+    this->cache_[id] = true;
+  }
+  for (const auto& txp : this->pending_) {
+    for (pgid_t id : txp.ids_) {
+      this->cache_[id] = true;
+    }
+  }
+}
+
+void FreeList::materialize() {
+  if (this->mapped_ids_ == nullptr) {
+    return;
+  }
+  // ids_ stays empty while the view is in use.
+  this->ids_.assign(this->mapped_ids_,
+                    this->mapped_ids_ + this->mapped_count_);
+  for (pgid_t id : this->ids_) {
+    this->cache_[id] = true;
+  }
+  this->mapped_ids_ = nullptr;
+  this->mapped_count_ = 0;
+}
+
+pgids_t FreeList::PendingIDs() const {
+  pgids_t ids;
+  ids.reserve(this->pending_count_);
+  for (const auto& txp : this->pending_) {
+    ids.insert(ids.end(), txp.ids_.begin(), txp.ids_.end());
+  }
+  return ids;
+}
+
+TxPending* FreeList::pendingFor(txid_t txid) {
+  assert((this->pending_.empty() || this->pending_.back().txid_ <= txid) &&
+         "pages freed out of txid order");
+  if (this->pending_.empty() || this->pending_.back().txid_ != txid) {
+    this->pending_.emplace_back();
+    TxPending& txp = this->pending_.back();
+    txp.txid_ = txid;
+    txp.last_release_begin_ = 0;
+  }
+  return &this->pending_.back();
 }
 
-int FreeList::PendingCount() {
-  int count = 0;
-  for (const auto& p : pending_) {
-    count += p.second->ids_.size();
+void FreeList::mergeReleased(pgids_t& released) {
+  if (released.empty()) {
+    return;
   }
-  return count;
+  this->materialize();
+  std::sort(released.begin(), released.end());
+  pgids_t merged;
+  merged.reserve(this->ids_.size() + released.size());
+  std::merge(this->ids_.begin(), this->ids_.end(), released.begin(),
+             released.end(), std::back_inserter(merged));
+  this->ids_.swap(merged);
 }
 
 }  // namespace boltdb
\ No newline at end of file
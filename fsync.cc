@@ -5,11 +5,11 @@
 namespace boltdb {
 Status fsync(int fd) {
 #ifdef USE_FDATASYNC
-  ::fdatasync(fd);
+  int ret = ::fdatasync(fd);
 #else
-  ::fsync(fd);
+  int ret = ::fsync(fd);
 #endif
-  return Status::OK();
+  return ret == 0 ? Status::OK() : Status::IOError();
 }
 }  // namespace boltdb
 #else
@@ -0,0 +1,24 @@
+#ifndef __BOLTDB_HASH_H__
+#define __BOLTDB_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace boltdb {
+
+#define FNV_PRIME 1099511628211UL
+#define FNV_OFFSET 14695981039346656037UL
+
+// Fnv1a64 returns the 64-bit FNV-1a hash of data[0, n).
+inline uint64_t Fnv1a64(const char* data, size_t n) {
+  uint64_t hash = FNV_OFFSET;
+  for (size_t i = 0; i < n; i++) {
+    hash = hash ^ data[i];
+    hash = hash * FNV_PRIME;
+  }
+  return hash;
+}
+
+}  // namespace boltdb
+
+#endif
@@ -1,16 +1,24 @@
 #ifndef __BOLTDB_BOLTDB_H__
 #define __BOLTDB_BOLTDB_H__
 
-#include <bitset>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "boltdb/comparator.h"
 #include "boltdb/noncopyable.h"
 #include "boltdb/slice.h"
 #include "boltdb/status.h"
@@ -46,6 +54,8 @@ class TxPending;
 class FreeList;
 class DB;
 class Cursor;
+class BufferPool;
+class WriteAheadLog;
 
 // PageFlags defination.
 static constexpr uint64_t kPageFlagBranch = 1;
@@ -53,11 +63,25 @@ static constexpr uint64_t kPageFlagLeaf = 1 << 1;
 static constexpr uint64_t kPageFlagMeta = 1 << 2;
 static constexpr uint64_t kPageFlagFreeList = 1 << 4;
 
+// kPgidNoFreelist marks a meta page whose freelist was not synced; the
+// freelist is then rebuilt from the reachable pages on open.
+static constexpr pgid_t kPgidNoFreelist = ~pgid_t(0);
+
+// LeafFlags defination.
+static constexpr uint32_t kBucketLeafFlag = 1;
+
 enum class FreeListType {
   FreeListArray,
   FreeListHashMap,
 };
 
+enum class IOBackend {
+  // The whole file is memory mapped and pages are read through the mapping.
+  Mmap,
+  // Pages are read on demand into a user-space buffer pool of fixed size.
+  BufferPool,
+};
+
 /**
  * @brief Page is an page represention in disk.
  * ------------------------------------------------------------------
@@ -81,6 +105,11 @@ struct __attribute__((packed)) Page {
   std::vector<BranchPageElement*> GetBranchPageElements();
   LeafPageElement* GetLeafPageElementAt(uint16_t index);
   std::vector<LeafPageElement*> GetLeafPageElements();
+  // SearchBranch/SearchLeaf return the index of the first element whose key
+  // is not less than key under cmp (count if there is none), and set *exact
+  // when that element's key equals key.
+  uint16_t SearchBranch(const Slice& key, const Comparator* cmp, bool* exact);
+  uint16_t SearchLeaf(const Slice& key, const Comparator* cmp, bool* exact);
 };
 
 /**
@@ -214,6 +243,84 @@ struct TxStats {
   TxStats Sub(const TxStats& other);
 };
 
+// Bucket represents a collection of key/value pairs inside the database.
+// A bucket is only valid for the lifetime of the transaction that returned
+// it, and so are the value slices it returns, which point into the mmap.
+struct Bucket : public noncopyable {
+ public:
+  Bucket(Tx* tx, const dBucket& hdr, Page* inline_page, const Comparator* cmp);
+
+  // Tx returns the tx of the bucket.
+  Tx* GetTx() const { return tx_; }
+
+  // Root returns the root of the bucket.
+  pgid_t Root() const { return hdr_.root; }
+
+  // Get retrieves the value for a key in the bucket.
+  // Returns NotFound if the key does not exist or if the key is a nested
+  // bucket, and IOError if a page on the way could not be read. Updates in
+  // an attached write-ahead log (see DB::AttachWal) shadow the tree.
+  Status Get(const Slice& key, Slice* value);
+
+  // MultiGet retrieves the values of many keys at once. The keys are sorted
+  // and walked down the tree together one level at a time: neighbouring keys
+  // that route through the same page share it, and readahead is requested
+  // for every distinct child page of a level before any of them is touched,
+  // so the page faults of a level overlap instead of being serialised.
+  // values and statuses are resized to keys.size() and filled in the order
+  // of keys; a key whose path hits an unreadable page gets IOError. Keys
+  // decided by an attached write-ahead log are answered from it.
+  void MultiGet(const std::vector<Slice>& keys, std::vector<Slice>* values,
+                std::vector<Status>* statuses);
+
+  // DeleteRange removes every key k with begin <= k < end. Subtrees whose
+  // whole key range lies inside [begin, end) are detached from their parent
+  // branch and their pages are handed to the freelist in one batch; their
+  // leaves are only scanned for nested buckets. Only the leaves straddling
+  // begin and end, and the branches above them, are rewritten. Nested
+  // buckets inside the range are deleted together with all their pages.
+  // Returns Invalid if the transaction is read-only, and IOError if a page
+  // could not be read, after which the transaction must be rolled back.
+  Status DeleteRange(const Slice& begin, const Slice& end);
+
+ private:
+  friend class Tx;
+  Page* rootPage();
+  // childIndex returns the index of the branch element to follow for key.
+  uint16_t childIndex(Page* branch, const Slice& key);
+  Status getFromLeaf(Page* leaf, const Slice& key, Slice* value);
+  // getFromWal looks key up in the updates still in the write-ahead log and
+  // returns whether the log decided it; *s is then OK or NotFound.
+  bool getFromWal(const Slice& key, Slice* value, Status* s);
+  // deleteRange removes [begin, end) from the subtree at p, whose keys are
+  // all below *upper unless upper is null, and sets *remaining to the number
+  // of elements left in p. Roots of covered subtrees and of removed nested
+  // buckets are appended to covered and emptied pages to freed; p itself is
+  // left to the caller when empty.
+  Status deleteRange(Page* p, const Slice& begin, const Slice& end,
+                     const Slice* upper, pgids_t* covered, pgids_t* freed,
+                     uint16_t* remaining);
+  // collect appends every page (with overflow) of the subtrees rooted at
+  // roots, and of the nested buckets in their leaves, to ids, one level at a
+  // time with readahead.
+  Status collect(pgids_t roots, pgids_t* ids);
+  // nestedRoot returns the root page of the nested bucket stored in e, or 0
+  // if e is not a bucket or is an inline one.
+  static pgid_t nestedRoot(LeafPageElement* e);
+  // rewrite replaces p with a copy holding only the elements set in keep
+  // and returns the copy.
+  Page* rewrite(Page* p, const std::vector<bool>& keep);
+
+ private:
+  Tx* tx_;
+  std::string name_;
+  dBucket hdr_;
+  Page* page_;  // inline page reference
+  // Rewritten inline page, owned by the bucket.
+  std::unique_ptr<char[]> inline_copy_;
+  const Comparator* cmp_;
+};
+
 // Tx represents a read-only or read/write transaction on the database.
 // Read-only transactions can be used for retrieving values for keys and
 // creating cursors. Read/write transactions can create and remove buckets and
@@ -225,7 +332,7 @@ struct TxStats {
 // quickly grow.
 class Tx : public noncopyable {
  public:
-  explicit Tx(DB* db);
+  explicit Tx(DB* db) : Tx(db, false) {}
   ~Tx();
 
   // ID returns the transaction id.
@@ -250,7 +357,7 @@ class Tx : public noncopyable {
   TxStats Stats() const { return stats_; }
 
   // Bucket retrieves a bucket by name.
-  // Returns nil if the bucket does not exist.
+  // Returns nil if the bucket does not exist or could not be read.
   // The bucket instance is only valid for the lifetime of the transaction.
   Bucket* GetBucket(const std::string& name);
 
@@ -285,7 +392,37 @@ class Tx : public noncopyable {
   Status Commit();
   Status Rollback();
 
+  // Check performs several consistency checks on the database for this
+  // transaction. Every bucket is walked on a pool of workers (one per core
+  // when workers is 0); each problem found is passed to on_error as soon as
+  // it is detected, and Corruption is returned if there was any. A read
+  // transaction checks against the freelist written with its meta page; if
+  // that freelist was not synced, leaked pages cannot be detected.
+  Status Check(const std::function<void(const std::string&)>& on_error,
+               int workers = 0);
+
  private:
+  friend struct Bucket;
+  friend class DB;
+  // Write transactions are started through DB::Begin.
+  Tx(DB* db, bool writable);
+  // page returns a reference to the page with a given id.
+  // If page has been written to then a temporary buffered page is returned.
+  // Returns nullptr if the buffer pool could not read the page.
+  Page* page(pgid_t id);
+  // acquire returns a page like page(), but on the buffer pool backend the
+  // pin is only held until release(id) instead of for the life of the tx.
+  // It is meant for pages that are visited in passing.
+  Page* acquire(pgid_t id);
+  void release(pgid_t id);
+  // prefetch asks the kernel to start reading a page that is about to be
+  // accessed. Pages already buffered by the tx are skipped.
+  void prefetch(pgid_t id);
+  // dirty replaces the page with the given id by buf (allocated with new[])
+  // for the rest of the tx.
+  void dirty(pgid_t id, char* buf);
+  // free hands pages to the freelist, pending until this tx is released.
+  void free(const pgids_t& ids);
   Status commitFreeList();
   void rollback();
   void Close();
@@ -295,8 +432,14 @@ class Tx : public noncopyable {
   bool managed_;
   DB* db_;
   Meta* meta_;
-  // Bucket root;
+  std::unordered_map<std::string, Bucket*> buckets_;
+  // Pages pinned in the buffer pool for the lifetime of the tx.
+  std::unordered_map<pgid_t, Page*> pinned_;
+  std::mutex pinned_mu_;
   std::map<pgid_t, Page*> pages_;
+  // Copies of values read from the write-ahead log, which may drop them at
+  // the next checkpoint.
+  std::deque<std::string> logged_values_;
   TxStats stats_;
   std::list<std::function<void()>> commit_handlers_;
   int write_flag_;
@@ -306,6 +449,7 @@ class Tx : public noncopyable {
 // that are pending to be freed.
 class TxPending {
  public:
+  txid_t txid_;
   pgids_t ids_;
   txids_t alloc_txs_;
   txid_t last_release_begin_;
@@ -314,6 +458,11 @@ class TxPending {
 // freelist represents a list of all pages that are available for allocation.
 // It also tracks pages that have been freed but are still in use by open
 // transactions.
+//
+// Pending pages are kept in a deque ordered by the txid that freed them. Since
+// writers are serialized and txids only grow, releasing everything up to the
+// oldest open reader is a pop from the front, and rolling back the current
+// writer is a pop from the back.
 class FreeList : public noncopyable {
  public:
   using allocate_fn_t = pgid_t (*)(txid_t, int);
@@ -332,13 +481,49 @@ class FreeList : public noncopyable {
   // arrayFreeCount returns count of free pages(array version)
   int ArrayFreeCount();
   // pending_count returns count of pending pages
-  int PendingCount();
+  int PendingCount() const { return pending_count_; }
+  // Free releases a page and its overflow for a given transaction id.
+  // The page must not already be free; freeing it twice is a bug in the
+  // caller and asserts in debug builds.
+  void Free(txid_t txid, Page* p);
+  // Free releases a batch of pages, overflow pages included, for a given
+  // transaction id.
+  void Free(txid_t txid, const pgids_t& ids);
+  // Release moves all page ids for a transaction id (or older) to the freelist.
+  void Release(txid_t txid);
+  // Rollback removes the pages from a given pending tx.
+  void Rollback(txid_t txid);
+  // Freed returns whether a given page is in the free list.
+  bool Freed(pgid_t pgid) const;
+  // PendingIDs returns the pending page ids ordered by the freeing txid.
+  pgids_t PendingIDs() const;
+  // FreeIDs returns the free (not pending) page ids, sorted.
+  pgids_t FreeIDs() const;
+  // Read initializes the freelist from a freelist page. With copy unset the
+  // sorted ids are used in place, so the page must stay mapped for as long
+  // as the freelist lives; they are copied out on the first modification.
+  void Read(Page* p, bool copy);
+  // ReadIDs initializes the freelist from a list of ids.
+  void ReadIDs(pgids_t ids);
+
+ private:
+  TxPending* pendingFor(txid_t txid);
+  void mergeReleased(pgids_t& released);
+  // materialize copies in-place ids from the freelist page into ids_.
+  void materialize();
+  // reindex rebuilds cache_ from ids_ and the pending pages.
+  void reindex();
 
  private:
   FreeListType freelist_type_;
   pgids_t ids_;
+  // Sorted free ids read in place from the mapped freelist page, kept apart
+  // from ids_ (and out of cache_) until the freelist is first modified.
+  const pgid_t* mapped_ids_;
+  size_t mapped_count_;
   std::unordered_map<pgid_t, txid_t> allocs_;
-  std::unordered_map<txid_t, TxPending*> pending_;
+  std::deque<TxPending> pending_;
+  int pending_count_;
   std::unordered_map<pgid_t, bool> cache_;
   std::unordered_map<uint64_t, pgidset_t> freemaps_;
   std::unordered_map<pgid_t, uint64_t> forward_map_;
@@ -363,6 +548,36 @@ struct Options {
   int pageSize;
   bool noSync;
   bool mlock;
+  // comparators maps a top-level bucket name to the ordering of its keys.
+  // Buckets not listed, and every nested bucket, use BytewiseComparator().
+  // The mapping is not recorded in the file: opening it with a different
+  // mapping is not detected, and lookups in the affected buckets go wrong
+  // (Tx::Check reports their keys as out of order).
+  std::unordered_map<std::string, const Comparator*> comparators;
+  // replica opens the file read-only without taking the file lock and
+  // follows another process writing it: the meta pages are re-read whenever
+  // the file changes (or every replicaPollInterval), the mmap grows with the
+  // file, and new read transactions see the newest consistent txid.
+  // The writer cannot see the replica's readers, so it may reuse the pages
+  // of a snapshot a replica transaction is still reading: keep replica
+  // transactions short, or expect torn reads (and Check failures) from
+  // transactions that outlive the writer's next few commits.
+  bool replica;
+  std::chrono::milliseconds replicaPollInterval;
+  // ioBackend selects how pages are accessed. With IOBackend::BufferPool at
+  // most bufferPoolSize bytes of pages are cached (read with O_DIRECT when
+  // directIO is set and the page size is a multiple of 4KB), and ioThreads
+  // threads serve readahead requests. Replica mode requires the mmap
+  // backend.
+  //
+  // Pages a transaction reaches through Get, MultiGet and GetBucket back
+  // the slices it returns, so they stay pinned until the transaction
+  // closes and may take the pool over budget. Check and DeleteRange only
+  // pin the pages they walk while visiting them.
+  IOBackend ioBackend;
+  size_t bufferPoolSize;
+  bool directIO;
+  int ioThreads;
 
   static Options Default();
 };
@@ -373,17 +588,90 @@ class DB : public noncopyable {
  public:
   DB(const DB&) = delete;
   DB& operator=(const DB&) = delete;
+  ~DB();
 
-  std::string Path() const;
+  std::string Path() const { return path_; }
   std::string String() const;
   std::string GoString() const;
   Status Sync();
-  bool IsReadOnly() const;
+  bool IsReadOnly() const { return opts_.readOnly || opts_.replica; }
   static Status Open(const std::string& path, Options& opts, DB** dbptr);
 
+  // Begin starts a new transaction. Multiple read-only transactions can be
+  // used concurrently but only one write transaction can be used at a time.
+  // Write transactions are not committed yet: their changes are rolled back
+  // when the Tx is deleted.
+  Status Begin(bool writable, Tx** txptr);
+
+  // Close releases all database resources. It will block waiting for any
+  // open transactions to finish before closing the database and returning.
+  Status Close();
+
+  // Refresh re-reads both meta pages and, if another process committed a
+  // newer transaction, grows the mmap as needed and makes that transaction
+  // visible to read transactions started afterwards. Only valid in replica
+  // mode; it is called automatically by the replica watcher.
+  //
+  // Refresh does not protect transactions already open: their pages may be
+  // freed and overwritten by the writer once newer commits land.
+  Status Refresh();
+
+  // AttachWal makes Get and MultiGet merge the updates logged in wal with
+  // the tree; a transaction sees the batches up to its own txid. Commits do
+  // not append to the log yet, so no option enables it: the owner of wal
+  // feeds and checkpoints it, and keeps it alive until the DB is closed.
+  // Must be called before any transaction begins.
+  void AttachWal(WriteAheadLog* wal) { this->wal_ = wal; }
+
+ private:
+  DB();
+  // page retrieves a page reference from the mmap based on the current page
+  // size.
+  Page* page(pgid_t id);
+  // meta retrieves the current meta page reference.
+  Meta* meta();
+  // adviseWillNeed starts readahead of the mapped range of a page.
+  void adviseWillNeed(pgid_t id, uint32_t pages);
+  Status init();
+  Status mmap(int64_t minsz);
+  Status munmap();
+  Status openBufferPool();
+  // loadFreelist reads the freelist page, or rebuilds the freelist from the
+  // reachable pages when it was not synced. It runs in the background after
+  // open; waitFreelist blocks until it is done.
+  Status loadFreelist();
+  Status waitFreelist();
+  Status mmapSize(int64_t size, int64_t* out) const;
+  void watch();
+
  private:
   friend class Tx;
+  friend struct Bucket;
+  std::string path_;
+  Options opts_;
+  int fd_;
   int page_size_;
+  char* data_;
+  int64_t datasz_;
+  Meta* meta0_;
+  Meta* meta1_;
+  // With the buffer pool backend the meta pages are copied here on open.
+  Meta metas_[2];
+  BufferPool* pool_;
+  WriteAheadLog* wal_;
+  FreeList* freelist_;
+  std::shared_future<Status> freelist_ready_;
+  std::unordered_map<std::string, const Comparator*> comparators_;
+
+  // Allows only one writer at a time.
+  std::mutex rwlock_;
+  // Protects mmap access during remapping.
+  std::shared_timed_mutex mmaplock_;
+
+  // Replica state: the newest consistent meta seen so far.
+  Meta replica_meta_;
+  std::thread watcher_;
+  std::atomic<bool> closing_;
 };
 
 }  // namespace boltdb
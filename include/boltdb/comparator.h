@@ -0,0 +1,91 @@
+#ifndef __BOLTDB_COMPARATOR_H__
+#define __BOLTDB_COMPARATOR_H__
+
+#include <cstdint>
+#include <cstring>
+
+#include "boltdb/slice.h"
+
+namespace boltdb {
+
+// A Comparator object provides a total order across keys of a bucket.
+// It must be thread-safe and must not change for the lifetime of a bucket,
+// since the on-disk element order depends on it.
+class Comparator {
+ public:
+  virtual ~Comparator() {}
+
+  // Three-way comparison.  Returns value:
+  //   <  0 iff "a" <  "b",
+  //   == 0 iff "a" == "b",
+  //   >  0 iff "a" >  "b"
+  virtual int Compare(const Slice& a, const Slice& b) const = 0;
+
+  // The name of the comparator, for diagnostics. It is not stored in the
+  // file, so opening a bucket with a different comparator goes undetected.
+  virtual const char* Name() const = 0;
+};
+
+// BytewiseCompare orders keys by memcmp, shorter keys first on a tie.
+// This is the default ordering of every bucket.
+struct BytewiseCompare {
+  static int Compare(const Slice& a, const Slice& b) { return a.compare(b); }
+};
+
+// BigEndianCompare orders fixed-width keys holding a big-endian unsigned
+// integer of type T. Keys of any other width fall back to bytewise order,
+// which agrees with the integer order for same-width keys.
+template <typename T>
+struct BigEndianCompare;
+
+template <>
+struct BigEndianCompare<uint64_t> {
+  static uint64_t Load(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+  }
+
+  static int Compare(const Slice& a, const Slice& b) {
+    if (a.size() != sizeof(uint64_t) || b.size() != sizeof(uint64_t)) {
+      return a.compare(b);
+    }
+    uint64_t x = Load(a.data());
+    uint64_t y = Load(b.data());
+    return (x > y) - (x < y);
+  }
+};
+
+#if defined(__SIZEOF_INT128__)
+template <>
+struct BigEndianCompare<unsigned __int128> {
+  static int Compare(const Slice& a, const Slice& b) {
+    if (a.size() != 16 || b.size() != 16) {
+      return a.compare(b);
+    }
+    uint64_t x = BigEndianCompare<uint64_t>::Load(a.data());
+    uint64_t y = BigEndianCompare<uint64_t>::Load(b.data());
+    if (x == y) {
+      x = BigEndianCompare<uint64_t>::Load(a.data() + 8);
+      y = BigEndianCompare<uint64_t>::Load(b.data() + 8);
+    }
+    return (x > y) - (x < y);
+  }
+};
+#endif
+
+// Return the builtin comparators. The results remain the property of this
+// module and must not be deleted. Page searches recognise these instances
+// and use an inlined specialization instead of a virtual call per probe.
+const Comparator* BytewiseComparator();
+const Comparator* BigEndianU64Comparator();
+#if defined(__SIZEOF_INT128__)
+const Comparator* BigEndianU128Comparator();
+#endif
+
+}  // namespace boltdb
+
+#endif
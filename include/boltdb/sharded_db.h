@@ -0,0 +1,128 @@
+#ifndef __BOLTDB_SHARDED_DB_H__
+#define __BOLTDB_SHARDED_DB_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+
+namespace boltdb {
+
+enum class ShardPartition {
+  // All keys of a bucket live on the shard chosen by hashing the bucket name.
+  HashBucket,
+  // Keys are spread over the shards by hashing bucket name and key.
+  HashKey,
+  // Keys are split into contiguous ranges by ShardOptions::splits.
+  Range,
+};
+
+struct ShardOptions {
+  int shards;
+  ShardPartition partition;
+  // splits holds shards-1 ascending keys for ShardPartition::Range; shard i
+  // holds the keys in [splits[i-1], splits[i]).
+  std::vector<std::string> splits;
+  // Options used to open every shard.
+  Options db;
+
+  static ShardOptions Default();
+};
+
+// ShardedSnapshot is a set of read transactions, one per shard, that all
+// started while no shard was committing, so they form one consistent view.
+class ShardedSnapshot : public noncopyable {
+ public:
+  ~ShardedSnapshot();
+
+  Tx* Shard(int i) const { return txs_[i]; }
+  int Shards() const { return int(txs_.size()); }
+
+ private:
+  friend class ShardedDB;
+  std::vector<Tx*> txs_;
+};
+
+// ShardedDB partitions data over several DB files in one directory so that
+// writes to different shards run in parallel: every shard has its own writer
+// thread and its own fsync stream.
+class ShardedDB : public noncopyable {
+ public:
+  using update_fn_t = std::function<Status(DB*)>;
+
+  ~ShardedDB();
+
+  // Open opens (creating if needed) the shard files under the directory
+  // path, all in parallel.
+  static Status Open(const std::string& path, ShardOptions& opts,
+                     ShardedDB** dbptr);
+
+  // Close stops the writer threads, after they finish every update already
+  // queued, and closes the shards. It may race other calls: updates and
+  // snapshots that lose the race fail with Invalid.
+  Status Close();
+
+  int Shards() const { return int(shards_.size()); }
+  // Shard returns the DB of shard i. It must not be used once Close has
+  // started.
+  DB* Shard(int i) const { return shards_[i]->db; }
+
+  // ShardFor returns the shard that owns key in bucket, or -1 once the
+  // database is closed.
+  int ShardFor(const Slice& bucket, const Slice& key) const;
+
+  // Update runs fn on the writer thread of the shard owning key and waits
+  // for it. fn performs one write transaction on that shard's DB. Updates
+  // of different shards run concurrently; updates of one shard run in
+  // submission order.
+  Status Update(const Slice& bucket, const Slice& key, update_fn_t fn);
+
+  // UpdateAsync is Update without waiting for the result. An out of range
+  // shard (or any shard once the database is closed) yields a ready future
+  // holding Status::Invalid().
+  std::future<Status> UpdateAsync(int shard, update_fn_t fn);
+
+  // BeginSnapshot starts a read transaction on every shard while commits on
+  // all shards are held off. Updates that have not started yet wait behind
+  // it, so a steady stream of updates cannot starve it. The caller deletes
+  // the snapshot when done. Returns Invalid once the database is closed.
+  Status BeginSnapshot(ShardedSnapshot** snap);
+
+ private:
+  struct ShardState {
+    DB* db;
+    std::thread writer;
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::packaged_task<Status()>> queue;
+    bool closing;
+  };
+
+  ShardedDB() : closed_(false) {}
+  void writeLoop(ShardState* shard);
+
+ private:
+  ShardOptions opts_;
+  // Fixed between Open and the destructor.
+  std::vector<ShardState*> shards_;
+  // Set by Close under commit_gate_.
+  std::atomic<bool> closed_;
+  // Writers hold it shared while running an update; snapshots take it
+  // exclusively so no shard is mid-commit while they start.
+  std::shared_timed_mutex commit_gate_;
+  // Taken by updates while they join commit_gate_ and by snapshots for as
+  // long as they wait for it, which makes the gate writer-preferring.
+  std::mutex turnstile_;
+};
+
+}  // namespace boltdb
+
+#endif
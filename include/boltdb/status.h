@@ -5,6 +5,8 @@ namespace boltdb {
 
 class Status {
 public:
+ Status() : code_(kOk) {}
+
  static Status OK();
  static Status NotFound();
  static Status Invalid();
@@ -13,6 +15,35 @@ public:
  static Status AlreadyExists();
  static Status InvalidName();
  static Status NotBucket();
+ static Status IOError();
+ static Status Corruption();
+ static Status Busy();
+
+ bool ok() const { return code_ == kOk; }
+ bool IsNotFound() const { return code_ == kNotFound; }
+ bool IsCorruption() const { return code_ == kCorruption; }
+ bool IsBusy() const { return code_ == kBusy; }
+ bool IsIOError() const { return code_ == kIOError; }
+ bool IsInvalid() const { return code_ == kInvalid; }
+
+private:
+ enum Code {
+   kOk = 0,
+   kNotFound,
+   kInvalid,
+   kVersionMismatch,
+   kChecksum,
+   kAlreadyExists,
+   kInvalidName,
+   kNotBucket,
+   kIOError,
+   kCorruption,
+   kBusy,
+ };
+
+ explicit Status(Code code) : code_(code) {}
+
+ Code code_;
 };
 }
 
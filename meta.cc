@@ -1,4 +1,5 @@
 #include "boltdb/boltdb.h"
+#include "hash.h"
 
 namespace boltdb {
 
@@ -31,22 +32,9 @@ void Meta::Write(Page* page) {
   this->Copy(page->AsMeta());
 }
 
-#define FNV_PRIME 1099511628211UL
-#define FNV_OFFSET 14695981039346656037UL
-
-static uint64_t fnv1a(char* key, int stringlen) {
-  uint64_t hash = FNV_OFFSET;
-  for (int i = 0; i < stringlen; i++) {
-    hash = hash ^ key[i];
-    hash = hash * FNV_PRIME;
-  }
-  return hash;
-}
-
 uint64_t Meta::Sum64() const {
   const char* base = reinterpret_cast<const char*>(this);
-  return fnv1a(const_cast<char*>(base),
-               static_cast<int>(offsetof(Meta, checksum)));
+  return Fnv1a64(base, offsetof(Meta, checksum));
 }
 
 }  // namespace boltdb
\ No newline at end of file
@@ -53,6 +53,64 @@ std::vector<LeafPageElement*> Page::GetLeafPageElements() {
   return vec;
 }
 
+template <typename Policy, typename Element>
+static uint16_t lowerBound(const Policy& policy, Element* base, uint16_t count,
+                           const Slice& key, bool* exact) {
+  uint16_t lo = 0, hi = count;
+  while (lo < hi) {
+    uint16_t mid = lo + (hi - lo) / 2;
+    if (policy.Compare(base[mid].key(), key) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *exact = lo < count && policy.Compare(base[lo].key(), key) == 0;
+  return lo;
+}
+
+namespace {
+// RuntimeCompare adapts a user supplied comparator to the search policy.
+struct RuntimeCompare {
+  const Comparator* cmp;
+  int Compare(const Slice& a, const Slice& b) const {
+    return cmp->Compare(a, b);
+  }
+};
+}  // namespace
+
+// Dispatch once per search to a loop specialized for the builtin comparators
+// so each probe is an inlined integer or memcmp compare.
+template <typename Element>
+static uint16_t search(Element* base, uint16_t count, const Slice& key,
+                       const Comparator* cmp, bool* exact) {
+  if (cmp == nullptr || cmp == BytewiseComparator()) {
+    return lowerBound(BytewiseCompare(), base, count, key, exact);
+  }
+  if (cmp == BigEndianU64Comparator()) {
+    return lowerBound(BigEndianCompare<uint64_t>(), base, count, key, exact);
+  }
+#if defined(__SIZEOF_INT128__)
+  if (cmp == BigEndianU128Comparator()) {
+    return lowerBound(BigEndianCompare<unsigned __int128>(), base, count, key,
+                      exact);
+  }
+#endif
+  return lowerBound(RuntimeCompare{cmp}, base, count, key, exact);
+}
+
+uint16_t Page::SearchBranch(const Slice& key, const Comparator* cmp,
+                            bool* exact) {
+  auto* base = reinterpret_cast<BranchPageElement*>(data);
+  return search(base, count, key, cmp, exact);
+}
+
+uint16_t Page::SearchLeaf(const Slice& key, const Comparator* cmp,
+                          bool* exact) {
+  auto* base = reinterpret_cast<LeafPageElement*>(data);
+  return search(base, count, key, cmp, exact);
+}
+
 Slice BranchPageElement::key() {
   const char* ptr = reinterpret_cast<const char*>(this);
   ptr += pos;
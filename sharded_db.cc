@@ -0,0 +1,213 @@
+#include "boltdb/sharded_db.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "hash.h"
+
+namespace boltdb {
+
+ShardOptions ShardOptions::Default() {
+  ShardOptions opts;
+  opts.shards = 4;
+  opts.partition = ShardPartition::HashBucket;
+  opts.db = Options::Default();
+  return opts;
+}
+
+ShardedSnapshot::~ShardedSnapshot() {
+  for (Tx* tx : txs_) {
+    delete tx;
+  }
+}
+
+ShardedDB::~ShardedDB() {
+  this->Close();
+  for (ShardState* shard : this->shards_) {
+    delete shard;
+  }
+}
+
+Status ShardedDB::Open(const std::string& path, ShardOptions& opts,
+                       ShardedDB** dbptr) {
+  if (opts.shards <= 0 ||
+      (opts.partition == ShardPartition::Range &&
+       opts.splits.size() != size_t(opts.shards - 1)) ||
+      !std::is_sorted(opts.splits.begin(), opts.splits.end())) {
+    return Status::Invalid();
+  }
+  if (::mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+    return Status::IOError();
+  }
+
+  auto* sdb = new ShardedDB();
+  sdb->opts_ = opts;
+  for (int i = 0; i < opts.shards; i++) {
+    auto* shard = new ShardState();
+    shard->db = nullptr;
+    shard->closing = false;
+    sdb->shards_.push_back(shard);
+  }
+
+  // Open all shards in parallel; each open validates meta pages and maps
+  // its own file.
+  std::vector<Status> statuses(opts.shards);
+  std::vector<std::thread> openers;
+  for (int i = 0; i < opts.shards; i++) {
+    openers.emplace_back([&, i] {
+      std::string file = path + "/shard-" + std::to_string(i) + ".db";
+      statuses[i] = DB::Open(file, sdb->opts_.db, &sdb->shards_[i]->db);
+    });
+  }
+  for (auto& t : openers) {
+    t.join();
+  }
+  for (const Status& s : statuses) {
+    if (!s.ok()) {
+      delete sdb;
+      return s;
+    }
+  }
+
+  for (ShardState* shard : sdb->shards_) {
+    shard->writer = std::thread(&ShardedDB::writeLoop, sdb, shard);
+  }
+  *dbptr = sdb;
+  return Status::OK();
+}
+
+Status ShardedDB::Close() {
+  // Snapshots check closed_ under the gate, so none is starting on a shard
+  // that is about to be closed.
+  {
+    std::lock_guard<std::mutex> turn(this->turnstile_);
+    std::unique_lock<std::shared_timed_mutex> gate(this->commit_gate_);
+    this->closed_ = true;
+  }
+
+  // The shard states themselves live until the destructor, so callers
+  // racing Close always find one to check.
+  Status result;
+  for (ShardState* shard : this->shards_) {
+    {
+      std::lock_guard<std::mutex> lock(shard->mu);
+      shard->closing = true;
+    }
+    shard->cv.notify_one();
+    if (shard->writer.joinable()) {
+      shard->writer.join();
+    }
+    if (shard->db != nullptr) {
+      Status s = shard->db->Close();
+      if (!s.ok()) {
+        result = s;
+      }
+      delete shard->db;
+      shard->db = nullptr;
+    }
+  }
+  return result;
+}
+
+int ShardedDB::ShardFor(const Slice& bucket, const Slice& key) const {
+  if (this->closed_) {
+    return -1;
+  }
+  int n = int(this->shards_.size());
+  switch (this->opts_.partition) {
+    case ShardPartition::HashBucket:
+      return int(Fnv1a64(bucket.data(), bucket.size()) % n);
+    case ShardPartition::HashKey: {
+      uint64_t h = Fnv1a64(bucket.data(), bucket.size());
+      return int((h ^ Fnv1a64(key.data(), key.size())) % n);
+    }
+    case ShardPartition::Range:
+    default: {
+      const auto& splits = this->opts_.splits;
+      auto it = std::upper_bound(
+          splits.begin(), splits.end(), key,
+          [](const Slice& k, const std::string& split) {
+            return k.compare(Slice(split)) < 0;
+          });
+      return int(it - splits.begin());
+    }
+  }
+}
+
+Status ShardedDB::Update(const Slice& bucket, const Slice& key,
+                         update_fn_t fn) {
+  return this->UpdateAsync(this->ShardFor(bucket, key), std::move(fn)).get();
+}
+
+static std::future<Status> invalidFuture() {
+  std::promise<Status> invalid;
+  invalid.set_value(Status::Invalid());
+  return invalid.get_future();
+}
+
+std::future<Status> ShardedDB::UpdateAsync(int shard, update_fn_t fn) {
+  if (shard < 0 || shard >= int(this->shards_.size())) {
+    return invalidFuture();
+  }
+  ShardState* s = this->shards_[shard];
+  std::unique_lock<std::mutex> lock(s->mu);
+  // The writer drains every task queued before closing was set, so a task
+  // is never dropped with its promise unset.
+  if (s->closing) {
+    return invalidFuture();
+  }
+  DB* db = s->db;
+  std::packaged_task<Status()> task([this, db, fn] {
+    // Pass through the turnstile so a waiting snapshot is not starved by
+    // the updates of other shards.
+    std::unique_lock<std::mutex> turn(this->turnstile_);
+    std::shared_lock<std::shared_timed_mutex> gate(this->commit_gate_);
+    turn.unlock();
+    return fn(db);
+  });
+  std::future<Status> result = task.get_future();
+  s->queue.push_back(std::move(task));
+  lock.unlock();
+  s->cv.notify_one();
+  return result;
+}
+
+void ShardedDB::writeLoop(ShardState* shard) {
+  std::unique_lock<std::mutex> lock(shard->mu);
+  while (true) {
+    shard->cv.wait(lock,
+                   [shard] { return shard->closing || !shard->queue.empty(); });
+    // Drain queued updates before honouring close.
+    if (shard->queue.empty()) {
+      return;
+    }
+    std::packaged_task<Status()> task = std::move(shard->queue.front());
+    shard->queue.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+Status ShardedDB::BeginSnapshot(ShardedSnapshot** snap) {
+  auto* s = new ShardedSnapshot();
+  {
+    // Holding the turnstile keeps new updates out while the running ones
+    // drain.
+    std::lock_guard<std::mutex> turn(this->turnstile_);
+    std::unique_lock<std::shared_timed_mutex> gate(this->commit_gate_);
+    if (this->closed_) {
+      delete s;
+      return Status::Invalid();
+    }
+    for (ShardState* shard : this->shards_) {
+      s->txs_.push_back(new Tx(shard->db));
+    }
+  }
+  *snap = s;
+  return Status::OK();
+}
+
+}  // namespace boltdb
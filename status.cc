@@ -2,39 +2,25 @@
 
 namespace boltdb {
 
-Status Status::OK() {
-  // TODO
-  return Status();
-}
-
-Status Status::NotFound() {
-  // TODO
-  return Status();
-}
-
-
-Status Status::Invalid() {
-  // TODO
-  return Status();
-}
-
-Status Status::VersionMismatch() {
-  // TODO
-  return Status();
-}
-
-Status Status::Checksum() {
-  // TODO
-  return Status();
-}
-
-Status Status::AlreadyExists() {
-  // TODO
-  return Status();
-}
-
-Status Status::InvalidName() {
-  // TODO
-  return Status();
-}
+Status Status::OK() { return Status(); }
+
+Status Status::NotFound() { return Status(kNotFound); }
+
+Status Status::Invalid() { return Status(kInvalid); }
+
+Status Status::VersionMismatch() { return Status(kVersionMismatch); }
+
+Status Status::Checksum() { return Status(kChecksum); }
+
+Status Status::AlreadyExists() { return Status(kAlreadyExists); }
+
+Status Status::InvalidName() { return Status(kInvalidName); }
+
+Status Status::NotBucket() { return Status(kNotBucket); }
+
+Status Status::IOError() { return Status(kIOError); }
+
+Status Status::Corruption() { return Status(kCorruption); }
+
+Status Status::Busy() { return Status(kBusy); }
 }
\ No newline at end of file
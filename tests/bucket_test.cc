@@ -0,0 +1,419 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+#include "gtest/gtest.h"
+#include "tests/test_util.h"
+#include "wal.h"
+
+using boltdb::Page;
+using boltdb::pgid_t;
+
+using page_at_t = std::function<Page*(pgid_t)>;
+
+// widgetsLayout lays out a "widgets" bucket with keys 0..499 (as big-endian
+// u64, value "v<n>") spread over 5 leaves under one branch, and an inline
+// bucket "tiny" holding "a" => "1".
+static pgid_t widgetsLayout(const page_at_t& at) {
+  // Root bucket leaf.
+  std::vector<char> tiny(getpagesize(), 0);
+  size_t tinysz =
+      writeLeaf(reinterpret_cast<Page*>(tiny.data()), {"a"}, {"1"});
+  writeLeaf(at(3), {"tiny", "widgets"},
+            {bucketValue(0) + std::string(tiny.data(), tinysz),
+             bucketValue(4)},
+            boltdb::kBucketLeafFlag);
+
+  // Branch page 4 over leaves 5..9.
+  std::vector<std::string> separators;
+  for (int i = 0; i < 5; i++) {
+    std::vector<std::string> keys, values;
+    for (int n = i * 100; n < (i + 1) * 100; n++) {
+      keys.push_back(bigEndian64(n));
+      values.push_back("v" + std::to_string(n));
+    }
+    writeLeaf(at(5 + i), keys, values);
+    separators.push_back(keys[0]);
+  }
+  writeBranch(at(4), separators, {5, 6, 7, 8, 9});
+  return 10;
+}
+
+// TestDB creates a file whose pages from 3 up are laid out by layout, with
+// page 3 the root bucket leaf; layout returns the high water mark.
+class TestDB {
+ public:
+  using layout_fn_t = std::function<pgid_t(const page_at_t&)>;
+
+  explicit TestDB(boltdb::Options opts = boltdb::Options::Default())
+      : TestDB(widgetsLayout, opts) {}
+
+  TestDB(const layout_fn_t& layout, boltdb::Options opts) {
+    path_ = tempPath("boltdb-bucket");
+
+    boltdb::Options init = boltdb::Options::Default();
+    boltdb::DB* db = nullptr;
+    EXPECT_TRUE(boltdb::DB::Open(path_, init, &db).ok());
+    delete db;
+
+    int page_size = getpagesize();
+    std::vector<char> file(kMaxPages * page_size, 0);
+    pgid_t high = layout([&](pgid_t id) {
+      EXPECT_LT(id, kMaxPages);
+      auto* p = reinterpret_cast<Page*>(&file[id * page_size]);
+      p->id = id;
+      return p;
+    });
+
+    int fd = open(path_.c_str(), O_RDWR);
+    EXPECT_EQ(ssize_t((high - 3) * page_size),
+              pwrite(fd, &file[3 * page_size], (high - 3) * page_size,
+                     3 * page_size));
+
+    // Commit txid 2 with the new high water mark.
+    boltdb::Meta m{};
+    m.magic = boltdb::kMagic;
+    m.version = boltdb::kVersion;
+    m.page_size = page_size;
+    m.freelist = 2;
+    m.root.root = 3;
+    m.pgid = high;
+    m.txid = 2;
+    std::vector<char> meta(page_size, 0);
+    m.Write(reinterpret_cast<Page*>(meta.data()));
+    EXPECT_EQ(ssize_t(page_size), pwrite(fd, meta.data(), page_size, 0));
+    close(fd);
+
+    EXPECT_TRUE(boltdb::DB::Open(path_, opts, &db_).ok());
+  }
+
+  ~TestDB() {
+    delete db_;
+    unlink(path_.c_str());
+  }
+
+  boltdb::DB* db() { return db_; }
+  const std::string& path() const { return path_; }
+
+ private:
+  static constexpr pgid_t kMaxPages = 16;
+
+  std::string path_;
+  boltdb::DB* db_;
+};
+
+TEST(BucketTest, TestGet) {
+  TestDB t;
+  boltdb::Tx tx(t.db());
+  boltdb::Bucket* b = tx.GetBucket("widgets");
+  ASSERT_NE(nullptr, b);
+  ASSERT_EQ(4, b->Root());
+  ASSERT_EQ(b, tx.GetBucket("widgets"));
+  ASSERT_EQ(nullptr, tx.GetBucket("nope"));
+
+  boltdb::Slice v;
+  ASSERT_TRUE(b->Get(bigEndian64(0), &v).ok());
+  ASSERT_EQ("v0", std::string(v.data(), v.size()));
+  ASSERT_TRUE(b->Get(bigEndian64(257), &v).ok());
+  ASSERT_EQ("v257", std::string(v.data(), v.size()));
+  ASSERT_TRUE(b->Get(bigEndian64(500), &v).IsNotFound());
+  ASSERT_TRUE(b->Get("short", &v).IsNotFound());
+
+  boltdb::Bucket* tiny = tx.GetBucket("tiny");
+  ASSERT_NE(nullptr, tiny);
+  ASSERT_TRUE(tiny->Get("a", &v).ok());
+  ASSERT_EQ("1", std::string(v.data(), v.size()));
+}
+
+TEST(BucketTest, TestMultiGet) {
+  TestDB t;
+  boltdb::Tx tx(t.db());
+  boltdb::Bucket* b = tx.GetBucket("widgets");
+  ASSERT_NE(nullptr, b);
+
+  // Unsorted, with duplicates and misses, spread across all leaves.
+  std::vector<uint64_t> ids = {499, 3, 250, 1000, 3, 100, 99, 0, 401, 777};
+  std::vector<std::string> storage;
+  for (uint64_t id : ids) {
+    storage.push_back(bigEndian64(id));
+  }
+  std::vector<boltdb::Slice> keys(storage.begin(), storage.end());
+
+  std::vector<boltdb::Slice> values;
+  std::vector<boltdb::Status> statuses;
+  b->MultiGet(keys, &values, &statuses);
+  ASSERT_EQ(ids.size(), values.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    if (ids[i] < 500) {
+      ASSERT_TRUE(statuses[i].ok());
+      ASSERT_EQ("v" + std::to_string(ids[i]),
+                std::string(values[i].data(), values[i].size()));
+    } else {
+      ASSERT_TRUE(statuses[i].IsNotFound());
+    }
+  }
+
+  boltdb::Bucket* tiny = tx.GetBucket("tiny");
+  tiny->MultiGet({"b", "a"}, &values, &statuses);
+  ASSERT_TRUE(statuses[0].IsNotFound());
+  ASSERT_TRUE(statuses[1].ok());
+}
+
+// Ensure that reads through the buffer pool backend see the same data.
+TEST(BucketTest, TestBufferPoolBackend) {
+  boltdb::Options opts = boltdb::Options::Default();
+  opts.ioBackend = boltdb::IOBackend::BufferPool;
+  opts.bufferPoolSize = 4 * getpagesize();
+  TestDB t(opts);
+  boltdb::Tx tx(t.db());
+  boltdb::Bucket* b = tx.GetBucket("widgets");
+  ASSERT_NE(nullptr, b);
+
+  std::vector<std::string> storage;
+  for (uint64_t id = 0; id < 500; id += 7) {
+    storage.push_back(bigEndian64(id));
+  }
+  std::vector<boltdb::Slice> keys(storage.begin(), storage.end());
+  std::vector<boltdb::Slice> values;
+  std::vector<boltdb::Status> statuses;
+  b->MultiGet(keys, &values, &statuses);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(statuses[i].ok());
+    ASSERT_EQ("v" + std::to_string(i * 7),
+              std::string(values[i].data(), values[i].size()));
+  }
+}
+
+// Ensure that a range delete detaches covered leaves and trims the boundary
+// leaves, leaving a consistent tree.
+TEST(BucketTest, TestDeleteRange) {
+  TestDB t;
+  {
+    boltdb::Tx tx(t.db());
+    boltdb::Bucket* b = tx.GetBucket("widgets");
+    ASSERT_TRUE(b->DeleteRange(bigEndian64(50), bigEndian64(450)).IsInvalid());
+  }
+
+  boltdb::Tx* tx = nullptr;
+  ASSERT_TRUE(t.db()->Begin(true, &tx).ok());
+  boltdb::Bucket* b = tx->GetBucket("widgets");
+  ASSERT_TRUE(b->DeleteRange(bigEndian64(50), bigEndian64(450)).ok());
+  boltdb::Slice v;
+  for (uint64_t id = 0; id < 500; id++) {
+    boltdb::Status s = b->Get(bigEndian64(id), &v);
+    ASSERT_EQ(id < 50 || id >= 450, s.ok()) << id;
+  }
+  // Leaves 6..8 are pending on the freelist and no longer reachable.
+  std::vector<std::string> errors;
+  ASSERT_TRUE(
+      tx->Check([&](const std::string& msg) { errors.push_back(msg); }, 2)
+          .ok());
+  ASSERT_TRUE(errors.empty());
+
+  // A reader checks its own snapshot, in which leaves 6..8 are still live
+  // and not yet freed.
+  {
+    boltdb::Tx rtx(t.db());
+    std::vector<std::string> rerrors;
+    ASSERT_TRUE(
+        rtx.Check([&](const std::string& msg) { rerrors.push_back(msg); }, 2)
+            .ok());
+    ASSERT_TRUE(rerrors.empty());
+  }
+
+  // Emptying the bucket leaves an empty root leaf.
+  ASSERT_TRUE(b->DeleteRange(bigEndian64(0), bigEndian64(1000)).ok());
+  ASSERT_TRUE(b->Get(bigEndian64(0), &v).IsNotFound());
+  ASSERT_TRUE(b->Get(bigEndian64(499), &v).IsNotFound());
+  ASSERT_TRUE(tx->Check([](const std::string&) {}, 2).ok());
+
+  boltdb::Bucket* tiny = tx->GetBucket("tiny");
+  ASSERT_TRUE(tiny->DeleteRange("a", "b").ok());
+  ASSERT_TRUE(tiny->Get("a", &v).IsNotFound());
+  delete tx;
+
+  // The write transaction was never committed.
+  boltdb::Tx rtx(t.db());
+  ASSERT_TRUE(rtx.GetBucket("widgets")->Get(bigEndian64(100), &v).ok());
+  ASSERT_TRUE(rtx.Check([](const std::string&) {}, 2).ok());
+}
+
+// Ensure that nested buckets inside a deleted range give back their pages.
+TEST(BucketTest, TestDeleteRangeNested) {
+  TestDB t(
+      [](const page_at_t& at) {
+        writeLeaf(at(3), {"outer"}, {bucketValue(4)},
+                  boltdb::kBucketLeafFlag);
+        // "k2" is a bucket rooted at 5, which holds a bucket rooted at 6.
+        writeLeaf(at(4), {"k1", "k2", "k3", "z"},
+                  {"1", bucketValue(5), "3", "26"});
+        at(4)->GetLeafPageElementAt(1)->flags = boltdb::kBucketLeafFlag;
+        writeLeaf(at(5), {"a", "b"}, {"1", bucketValue(6)});
+        at(5)->GetLeafPageElementAt(1)->flags = boltdb::kBucketLeafFlag;
+        writeLeaf(at(6), {"x"}, {"y"});
+        return pgid_t(7);
+      },
+      boltdb::Options::Default());
+
+  boltdb::Tx* raw = nullptr;
+  ASSERT_TRUE(t.db()->Begin(true, &raw).ok());
+  std::unique_ptr<boltdb::Tx> tx(raw);
+  boltdb::Bucket* b = tx->GetBucket("outer");
+  ASSERT_NE(nullptr, b);
+  ASSERT_TRUE(b->DeleteRange("k0", "k9").ok());
+  boltdb::Slice v;
+  ASSERT_TRUE(b->Get("k1", &v).IsNotFound());
+  ASSERT_TRUE(b->Get("z", &v).ok());
+
+  std::vector<std::string> errors;
+  ASSERT_TRUE(
+      tx->Check([&](const std::string& msg) { errors.push_back(msg); }, 2)
+          .ok());
+  ASSERT_EQ(std::vector<std::string>(), errors);
+}
+
+// Ensure that readers see the updates of an attached write-ahead log up to
+// their own txid.
+TEST(BucketTest, TestGetMergesWal) {
+  TestDB t;
+  std::string path = tempPath("boltdb-wal");
+  boltdb::WriteAheadLog* wal = nullptr;
+  ASSERT_TRUE(boltdb::WriteAheadLog::Open(path, &wal).ok());
+  using boltdb::WalOp;
+  ASSERT_TRUE(
+      wal->Append(2, {{WalOp::Put, "widgets", bigEndian64(5), "logged"},
+                      {WalOp::Delete, "widgets", bigEndian64(6), ""},
+                      {WalOp::Put, "widgets", bigEndian64(1000), "new"}})
+          .ok());
+  ASSERT_TRUE(
+      wal->Append(3, {{WalOp::Put, "widgets", bigEndian64(7), "later"}}).ok());
+  t.db()->AttachWal(wal);
+  {
+    boltdb::Tx tx(t.db());
+    ASSERT_EQ(2, tx.ID());
+    boltdb::Bucket* b = tx.GetBucket("widgets");
+    boltdb::Slice v;
+    ASSERT_TRUE(b->Get(bigEndian64(5), &v).ok());
+    ASSERT_EQ("logged", std::string(v));
+    ASSERT_TRUE(b->Get(bigEndian64(6), &v).IsNotFound());
+    ASSERT_TRUE(b->Get(bigEndian64(1000), &v).ok());
+    ASSERT_EQ("new", std::string(v));
+    // Batch 3 is newer than the transaction.
+    ASSERT_TRUE(b->Get(bigEndian64(7), &v).ok());
+    ASSERT_EQ("v7", std::string(v));
+
+    std::vector<std::string> keys = {bigEndian64(1000), bigEndian64(6),
+                                     bigEndian64(8), bigEndian64(5)};
+    std::vector<boltdb::Slice> values;
+    std::vector<boltdb::Status> statuses;
+    b->MultiGet({keys[0], keys[1], keys[2], keys[3]}, &values, &statuses);
+    ASSERT_TRUE(statuses[0].ok());
+    ASSERT_EQ("new", std::string(values[0]));
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_TRUE(statuses[2].ok());
+    ASSERT_EQ("v8", std::string(values[2]));
+    ASSERT_TRUE(statuses[3].ok());
+    ASSERT_EQ("logged", std::string(values[3]));
+  }
+  t.db()->AttachWal(nullptr);
+  delete wal;
+  unlink(path.c_str());
+}
+
+// Ensure that checker workers can share a tx on the buffer pool backend.
+TEST(BucketTest, TestCheckBufferPool) {
+  boltdb::Options opts = boltdb::Options::Default();
+  opts.ioBackend = boltdb::IOBackend::BufferPool;
+  opts.bufferPoolSize = 4 * getpagesize();
+  opts.ioThreads = 2;
+  TestDB t(opts);
+  for (int i = 0; i < 20; i++) {
+    boltdb::Tx tx(t.db());
+    std::vector<std::string> errors;
+    ASSERT_TRUE(
+        tx.Check([&](const std::string& msg) { errors.push_back(msg); }, 4)
+            .ok());
+    ASSERT_TRUE(errors.empty());
+  }
+}
+
+// Ensure that pages missing from a truncated file are reported rather than
+// dereferenced.
+TEST(BucketTest, TestUnreadablePages) {
+  boltdb::Options opts = boltdb::Options::Default();
+  opts.ioBackend = boltdb::IOBackend::BufferPool;
+  opts.bufferPoolSize = 16 * getpagesize();
+  TestDB t(opts);
+  ASSERT_EQ(0, truncate(t.path().c_str(), 7 * getpagesize()));
+
+  boltdb::Tx tx(t.db());
+  boltdb::Bucket* b = tx.GetBucket("widgets");
+  ASSERT_NE(nullptr, b);
+  boltdb::Slice v;
+  ASSERT_TRUE(b->Get(bigEndian64(50), &v).ok());
+  ASSERT_TRUE(b->Get(bigEndian64(250), &v).IsIOError());
+
+  std::string k0 = bigEndian64(150), k1 = bigEndian64(450);
+  std::vector<boltdb::Slice> values;
+  std::vector<boltdb::Status> statuses;
+  b->MultiGet({k0, k1}, &values, &statuses);
+  ASSERT_TRUE(statuses[0].ok());
+  ASSERT_TRUE(statuses[1].IsIOError());
+
+  std::vector<std::string> errors;
+  ASSERT_TRUE(
+      tx.Check([&](const std::string& msg) { errors.push_back(msg); }, 4)
+          .IsCorruption());
+  std::sort(errors.begin(), errors.end());
+  ASSERT_EQ(std::vector<std::string>({"page 7: unreadable",
+                                      "page 8: unreadable",
+                                      "page 9: unreadable"}),
+            errors);
+}
+
+// Ensure that overflow counts reaching past the end of the file make the
+// page unreadable instead of sizing its frame.
+TEST(BucketTest, TestBogusOverflow) {
+  boltdb::Options opts = boltdb::Options::Default();
+  opts.ioBackend = boltdb::IOBackend::BufferPool;
+  opts.bufferPoolSize = 16 * getpagesize();
+  TestDB t(opts);
+  int fd = open(t.path().c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  std::vector<char> buf(getpagesize());
+  auto* p = reinterpret_cast<Page*>(buf.data());
+  for (pgid_t id : {7, 8}) {
+    off_t offset = off_t(id) * getpagesize();
+    ASSERT_EQ(ssize_t(buf.size()), pread(fd, buf.data(), buf.size(), offset));
+    p->overflow = id == 7 ? 0xFFFFFFFF : 1000;
+    ASSERT_EQ(ssize_t(buf.size()), pwrite(fd, buf.data(), buf.size(), offset));
+  }
+  close(fd);
+
+  boltdb::Tx tx(t.db());
+  boltdb::Bucket* b = tx.GetBucket("widgets");
+  ASSERT_NE(nullptr, b);
+  boltdb::Slice v;
+  ASSERT_TRUE(b->Get(bigEndian64(250), &v).IsIOError());
+  ASSERT_TRUE(b->Get(bigEndian64(350), &v).IsIOError());
+
+  std::vector<std::string> errors;
+  ASSERT_TRUE(
+      tx.Check([&](const std::string& msg) { errors.push_back(msg); }, 4)
+          .IsCorruption());
+  std::sort(errors.begin(), errors.end());
+  ASSERT_EQ(
+      std::vector<std::string>({"page 7: unreadable", "page 8: unreadable"}),
+      errors);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,113 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+#include "buffer_pool.h"
+#include "gtest/gtest.h"
+
+using boltdb::BufferPool;
+
+static constexpr uint32_t kTestPageSize = 4096;
+
+// writeFile creates a file of n pages whose headers carry their own id; page
+// 5 has two overflow pages.
+static std::string writeFile(boltdb::pgid_t n) {
+  char buf[] = "/tmp/boltdb-pool-XXXXXX";
+  int fd = mkstemp(buf);
+  std::vector<char> file(n * kTestPageSize, 0);
+  for (boltdb::pgid_t id = 0; id < n; id++) {
+    auto* p = reinterpret_cast<boltdb::Page*>(&file[id * kTestPageSize]);
+    p->id = id;
+    p->overflow = id == 5 ? 2 : 0;
+    p->data[0] = char('a' + id);
+  }
+  file[7 * kTestPageSize + 100] = 'z';
+  EXPECT_EQ(ssize_t(file.size()), write(fd, file.data(), file.size()));
+  close(fd);
+  return buf;
+}
+
+TEST(BufferPoolTest, TestFetchAndEvict) {
+  std::string path = writeFile(16);
+  BufferPool* pool = nullptr;
+  ASSERT_TRUE(
+      BufferPool::Open(path, kTestPageSize, 4 * kTestPageSize, true, 0, &pool)
+          .ok());
+
+  for (boltdb::pgid_t id = 0; id < 16; id++) {
+    if (id >= 5 && id <= 7) {
+      continue;
+    }
+    BufferPool::PageRef ref;
+    ASSERT_TRUE(pool->Fetch(id, &ref).ok());
+    ASSERT_EQ(id, ref->id);
+    ASSERT_EQ(char('a' + id), ref->data[0]);
+    ASSERT_LE(pool->Resident(), 4 * kTestPageSize);
+  }
+
+  // Overflow pages are read together with their first page.
+  BufferPool::PageRef big;
+  ASSERT_TRUE(pool->Fetch(5, &big).ok());
+  ASSERT_EQ(2, big->overflow);
+  ASSERT_EQ('z', reinterpret_cast<char*>(big.get())[2 * kTestPageSize + 100]);
+  big.Release();
+
+  // Every frame pinned: a strict fetch fails, a forced pin goes over budget.
+  std::vector<BufferPool::PageRef> refs(4);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(pool->Fetch(i, &refs[i]).ok());
+  }
+  BufferPool::PageRef extra;
+  ASSERT_TRUE(pool->Fetch(10, &extra).IsBusy());
+  boltdb::Page* p = pool->Pin(10);
+  ASSERT_NE(nullptr, p);
+  ASSERT_EQ(10, p->id);
+  pool->Unpin(10);
+
+  // Reading past the end of the file fails.
+  refs.clear();
+  ASSERT_FALSE(pool->Fetch(100, &extra).ok());
+
+  delete pool;
+  unlink(path.c_str());
+}
+
+TEST(BufferPoolTest, TestPrefetch) {
+  std::string path = writeFile(16);
+  BufferPool* pool = nullptr;
+  ASSERT_TRUE(
+      BufferPool::Open(path, kTestPageSize, 8 * kTestPageSize, false, 2, &pool)
+          .ok());
+  for (boltdb::pgid_t id = 8; id < 12; id++) {
+    pool->Prefetch(id);
+  }
+  for (boltdb::pgid_t id = 8; id < 12; id++) {
+    BufferPool::PageRef ref;
+    ASSERT_TRUE(pool->Fetch(id, &ref).ok());
+    ASSERT_EQ(id, ref->id);
+  }
+  delete pool;
+  unlink(path.c_str());
+}
+
+// Ensure that direct I/O falls back to buffered reads for page sizes that
+// are not block aligned.
+TEST(BufferPoolTest, TestDirectUnalignedPageSize) {
+  std::string path = writeFile(16);
+  BufferPool* pool = nullptr;
+  ASSERT_TRUE(BufferPool::Open(path, 1024, 8 * 1024, true, 0, &pool).ok());
+  BufferPool::PageRef ref;
+  ASSERT_TRUE(pool->Fetch(4, &ref).ok());
+  ASSERT_EQ(1, ref->id);
+  ref.Release();
+  delete pool;
+  unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
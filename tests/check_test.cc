@@ -0,0 +1,150 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+#include "buffer_pool.h"
+#include "check.h"
+#include "gtest/gtest.h"
+#include "tests/test_util.h"
+
+static constexpr uint32_t kTestPageSize = 256;
+
+// TestFile lays out pages in memory the way they would appear in the mmap.
+class TestFile {
+ public:
+  explicit TestFile(boltdb::pgid_t n) : buf_(n * kTestPageSize, 0) {
+    for (boltdb::pgid_t id = 0; id < n; id++) {
+      page(id)->id = id;
+    }
+  }
+
+  boltdb::Page* page(boltdb::pgid_t id) {
+    return reinterpret_cast<boltdb::Page*>(&buf_[id * kTestPageSize]);
+  }
+
+  void Leaf(boltdb::pgid_t id, const std::vector<std::string>& keys,
+            uint32_t flags = 0, const std::string& value = "") {
+    writeLeaf(page(id), keys, std::vector<std::string>(keys.size(), value),
+              flags);
+  }
+
+  void Branch(boltdb::pgid_t id, const std::vector<std::string>& keys,
+              const std::vector<boltdb::pgid_t>& children) {
+    writeBranch(page(id), keys, children);
+  }
+
+  const std::vector<char>& data() const { return buf_; }
+
+ private:
+  std::vector<char> buf_;
+};
+
+// Build: root bucket leaf (2) -> "widgets" branch (3) -> leaves (4, 5).
+static void buildTree(TestFile* f) {
+  f->Leaf(2, {"widgets"}, boltdb::kBucketLeafFlag, bucketValue(3));
+  f->Branch(3, {"a", "m"}, {4, 5});
+  f->Leaf(4, {"a", "b", "c"});
+  f->Leaf(5, {"m", "n"});
+}
+
+static boltdb::Status runCheck(TestFile* f, boltdb::pgid_t high_water,
+                               const boltdb::FreeList* freelist,
+                               std::vector<std::string>* errors) {
+  boltdb::Checker checker([f](boltdb::pgid_t id) { return f->page(id); },
+                          kTestPageSize, high_water, freelist);
+  checker.Reserve(0, 0);
+  checker.Reserve(1, 0);
+  return checker.Run(2, 4, [errors](const std::string& msg) {
+    errors->push_back(msg);
+  });
+}
+
+TEST(CheckTest, TestPageBitmap) {
+  boltdb::PageBitmap bm(130);
+  ASSERT_FALSE(bm.Mark(129));
+  ASSERT_TRUE(bm.Mark(129));
+  ASSERT_TRUE(bm.Test(129));
+  ASSERT_FALSE(bm.Test(64));
+}
+
+TEST(CheckTest, TestConsistent) {
+  TestFile f(7);
+  buildTree(&f);
+  boltdb::FreeList freelist(boltdb::FreeListType::FreeListArray);
+  freelist.Free(10, f.page(6));
+
+  std::vector<std::string> errors;
+  ASSERT_TRUE(runCheck(&f, 7, &freelist, &errors).ok());
+  ASSERT_TRUE(errors.empty());
+}
+
+TEST(CheckTest, TestLeakedPage) {
+  TestFile f(7);
+  buildTree(&f);
+
+  std::vector<std::string> errors;
+  ASSERT_TRUE(runCheck(&f, 7, nullptr, &errors).IsCorruption());
+  ASSERT_EQ(std::vector<std::string>({"page 6: unreachable unfreed"}), errors);
+}
+
+TEST(CheckTest, TestDoubleReferenceAndOrder) {
+  TestFile f(6);
+  buildTree(&f);
+  f.Branch(3, {"a", "m"}, {4, 4});
+  f.Leaf(4, {"a", "c", "b"});
+
+  std::vector<std::string> errors;
+  ASSERT_TRUE(runCheck(&f, 6, nullptr, &errors).IsCorruption());
+  auto has = [&errors](const std::string& msg) {
+    return std::find(errors.begin(), errors.end(), msg) != errors.end();
+  };
+  ASSERT_TRUE(has("page 4: multiple references"));
+  ASSERT_TRUE(has("page 4: element 2 out of order"));
+  ASSERT_TRUE(has("page 5: unreachable unfreed"));
+}
+
+// Ensure that the checker releases pages as it goes, so a walk through the
+// buffer pool stays within its budget.
+TEST(CheckTest, TestBufferPoolBudget) {
+  const boltdb::pgid_t leaves = 10;
+  TestFile f(4 + leaves);
+  f.Leaf(2, {"widgets"}, boltdb::kBucketLeafFlag, bucketValue(3));
+  std::vector<std::string> keys;
+  std::vector<boltdb::pgid_t> children;
+  for (boltdb::pgid_t i = 0; i < leaves; i++) {
+    keys.push_back("k" + std::to_string(100 + i));
+    children.push_back(4 + i);
+    f.Leaf(4 + i, {keys.back()});
+  }
+  f.Branch(3, keys, children);
+
+  std::string path = tempPath("boltdb-check");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  ASSERT_EQ(ssize_t(f.data().size()),
+            write(fd, f.data().data(), f.data().size()));
+  close(fd);
+
+  boltdb::BufferPool* pool = nullptr;
+  ASSERT_TRUE(boltdb::BufferPool::Open(path, kTestPageSize, 4 * kTestPageSize,
+                                       false, 0, &pool)
+                  .ok());
+  boltdb::Checker checker([pool](boltdb::pgid_t id) { return pool->Pin(id); },
+                          kTestPageSize, 4 + leaves, nullptr);
+  checker.SetRelease([pool](boltdb::pgid_t id) { pool->Unpin(id); });
+  checker.Reserve(0, 0);
+  checker.Reserve(1, 0);
+  ASSERT_TRUE(checker.Run(2, 4, [](const std::string&) {}).ok());
+  ASSERT_LE(pool->Resident(), 4 * kTestPageSize);
+
+  delete pool;
+  unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
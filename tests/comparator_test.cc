@@ -0,0 +1,68 @@
+#include <string>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+#include "gtest/gtest.h"
+#include "tests/test_util.h"
+
+// buildLeaf lays out a leaf page holding keys (with empty values) in buf.
+static boltdb::Page* buildLeaf(std::vector<char>* buf,
+                               const std::vector<std::string>& keys) {
+  buf->assign(4096, 0);
+  auto* p = reinterpret_cast<boltdb::Page*>(buf->data());
+  writeLeaf(p, keys, std::vector<std::string>(keys.size()));
+  return p;
+}
+
+TEST(ComparatorTest, TestBigEndianU64) {
+  const boltdb::Comparator* cmp = boltdb::BigEndianU64Comparator();
+  ASSERT_LT(cmp->Compare(bigEndian64(1), bigEndian64(256)), 0);
+  ASSERT_GT(cmp->Compare(bigEndian64(UINT64_MAX), bigEndian64(0)), 0);
+  ASSERT_EQ(0, cmp->Compare(bigEndian64(42), bigEndian64(42)));
+}
+
+#if defined(__SIZEOF_INT128__)
+TEST(ComparatorTest, TestBigEndianU128) {
+  const boltdb::Comparator* cmp = boltdb::BigEndianU128Comparator();
+  std::string a = bigEndian64(1) + bigEndian64(UINT64_MAX);
+  std::string b = bigEndian64(2) + bigEndian64(0);
+  ASSERT_LT(cmp->Compare(a, b), 0);
+  ASSERT_GT(cmp->Compare(b, a), 0);
+  ASSERT_EQ(0, cmp->Compare(a, a));
+}
+#endif
+
+TEST(ComparatorTest, TestSearchLeaf) {
+  std::vector<char> buf;
+  std::vector<std::string> keys;
+  for (uint64_t v : {3, 10, 300, 70000}) {
+    keys.push_back(bigEndian64(v));
+  }
+  boltdb::Page* p = buildLeaf(&buf, keys);
+
+  // Builtin and generic comparators must agree with each other.
+  struct Generic : public boltdb::Comparator {
+    int Compare(const boltdb::Slice& a, const boltdb::Slice& b) const {
+      return boltdb::BytewiseComparator()->Compare(a, b);
+    }
+    const char* Name() const { return "test.Bytewise"; }
+  } generic;
+
+  for (const boltdb::Comparator* cmp :
+       {boltdb::BigEndianU64Comparator(), boltdb::BytewiseComparator(),
+        static_cast<const boltdb::Comparator*>(&generic)}) {
+    bool exact = false;
+    ASSERT_EQ(2, p->SearchLeaf(bigEndian64(300), cmp, &exact));
+    ASSERT_TRUE(exact);
+    ASSERT_EQ(2, p->SearchLeaf(bigEndian64(11), cmp, &exact));
+    ASSERT_FALSE(exact);
+    ASSERT_EQ(0, p->SearchLeaf(bigEndian64(0), cmp, &exact));
+    ASSERT_EQ(4, p->SearchLeaf(bigEndian64(80000), cmp, &exact));
+    ASSERT_FALSE(exact);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,290 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+#include "gtest/gtest.h"
+#include "tests/test_util.h"
+
+// commitMeta simulates a writer in another process committing txid with a
+// file of pgid pages.
+static void commitMeta(const std::string& path, boltdb::txid_t txid,
+                       boltdb::pgid_t pgid, boltdb::pgid_t freelist = 2) {
+  int page_size = getpagesize();
+  int fd = open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(0, ftruncate(fd, off_t(pgid) * page_size));
+
+  std::vector<char> buf(page_size, 0);
+  auto* p = reinterpret_cast<boltdb::Page*>(buf.data());
+  boltdb::Meta m{};
+  m.magic = boltdb::kMagic;
+  m.version = boltdb::kVersion;
+  m.page_size = page_size;
+  m.freelist = freelist;
+  m.root.root = 3;
+  m.pgid = pgid;
+  m.txid = txid;
+  m.Write(p);
+  ASSERT_EQ(page_size, pwrite(fd, buf.data(), page_size,
+                              off_t(p->id) * page_size));
+  close(fd);
+}
+
+TEST(DBTest, TestOpen) {
+  std::string path = tempPath("boltdb-db");
+  boltdb::Options opts = boltdb::Options::Default();
+  boltdb::DB* db = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  ASSERT_EQ(path, db->Path());
+  {
+    boltdb::Tx tx(db);
+    ASSERT_EQ(1, tx.ID());
+    ASSERT_EQ(4 * getpagesize(), tx.Size());
+  }
+  ASSERT_TRUE(db->Close().ok());
+  delete db;
+
+  // Reopen the initialized file.
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  {
+    boltdb::Tx tx(db);
+    ASSERT_EQ(1, tx.ID());
+  }
+  delete db;
+  unlink(path.c_str());
+}
+
+// Ensure that a replica picks up commits and file growth from a writer.
+TEST(DBTest, TestReplicaRefresh) {
+  std::string path = tempPath("boltdb-db");
+  boltdb::Options opts = boltdb::Options::Default();
+  boltdb::DB* db = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  delete db;
+
+  boltdb::Options ropts = boltdb::Options::Default();
+  ropts.replica = true;
+  ropts.replicaPollInterval = std::chrono::milliseconds(10);
+  boltdb::DB* replica = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, ropts, &replica).ok());
+  ASSERT_TRUE(replica->IsReadOnly());
+
+  // Grow well past the initial 32KB mapping.
+  commitMeta(path, 2, 100);
+  ASSERT_TRUE(replica->Refresh().ok());
+  {
+    boltdb::Tx tx(replica);
+    ASSERT_EQ(2, tx.ID());
+    ASSERT_EQ(100 * getpagesize(), tx.Size());
+  }
+
+  // The watcher should pick up the next commit on its own.
+  commitMeta(path, 3, 120);
+  int id = 0;
+  for (int i = 0; i < 200 && id != 3; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    boltdb::Tx tx(replica);
+    id = tx.ID();
+  }
+  ASSERT_EQ(3, id);
+
+  delete replica;
+  unlink(path.c_str());
+}
+
+// Ensure that racing refreshes never move a replica back to an older txid.
+TEST(DBTest, TestReplicaConcurrentRefresh) {
+  std::string path = tempPath("boltdb-db");
+  boltdb::Options opts = boltdb::Options::Default();
+  boltdb::DB* db = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  delete db;
+
+  boltdb::Options ropts = boltdb::Options::Default();
+  ropts.replica = true;
+  ropts.replicaPollInterval = std::chrono::milliseconds(1);
+  boltdb::DB* replica = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, ropts, &replica).ok());
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; i++) {
+    threads.emplace_back([&] {
+      while (!stop) {
+        replica->Refresh();
+      }
+    });
+  }
+  std::atomic<bool> backwards(false);
+  threads.emplace_back([&] {
+    boltdb::txid_t last = 0;
+    while (!stop) {
+      boltdb::Tx tx(replica);
+      if (tx.ID() < last) {
+        backwards = true;
+      }
+      last = tx.ID();
+    }
+  });
+
+  // Grow the file with every commit so that refreshes remap.
+  for (boltdb::txid_t txid = 2; txid < 100; txid++) {
+    commitMeta(path, txid, 8 + txid * 4);
+  }
+  stop = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_FALSE(backwards);
+  ASSERT_TRUE(replica->Refresh().ok());
+  {
+    boltdb::Tx tx(replica);
+    ASSERT_EQ(99, tx.ID());
+  }
+
+  delete replica;
+  unlink(path.c_str());
+}
+
+// writeFreelist overwrites the freelist page at page 2 with ids.
+static void writeFreelist(const std::string& path,
+                          const boltdb::pgids_t& ids) {
+  int page_size = getpagesize();
+  int fd = open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  std::vector<char> buf(page_size, 0);
+  auto* p = reinterpret_cast<boltdb::Page*>(buf.data());
+  p->id = 2;
+  p->flags = boltdb::kPageFlagFreeList;
+  p->count = uint16_t(ids.size());
+  std::copy(ids.begin(), ids.end(),
+            reinterpret_cast<boltdb::pgid_t*>(p->data));
+  ASSERT_EQ(page_size, pwrite(fd, buf.data(), page_size, 2 * page_size));
+  close(fd);
+}
+
+// Ensure that the freelist loaded in the background after open accounts for
+// every unreachable page, whether read from its page or rebuilt.
+TEST(DBTest, TestLazyFreelist) {
+  std::string path = tempPath("boltdb-db");
+  boltdb::Options opts = boltdb::Options::Default();
+  boltdb::DB* db = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  delete db;
+
+  // Pages 4..7 are listed on the freelist page.
+  commitMeta(path, 2, 8);
+  writeFreelist(path, {4, 5, 6, 7});
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  {
+    boltdb::Tx tx(db);
+    ASSERT_EQ(2, tx.ID());
+    std::vector<std::string> errors;
+    ASSERT_TRUE(
+        tx.Check([&](const std::string& msg) { errors.push_back(msg); }, 2)
+            .ok());
+    ASSERT_TRUE(errors.empty());
+  }
+  delete db;
+
+  // Without a synced freelist pages 2 and 4..9 are found by walking the
+  // tree.
+  commitMeta(path, 3, 10, boltdb::kPgidNoFreelist);
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  {
+    boltdb::Tx tx(db);
+    ASSERT_EQ(3, tx.ID());
+    ASSERT_TRUE(tx.Check([](const std::string&) {}, 2).ok());
+  }
+  delete db;
+
+  // A read-only handle never loads the freelist; Check reads it itself.
+  commitMeta(path, 4, 8);
+  boltdb::Options ropts = boltdb::Options::Default();
+  ropts.readOnly = true;
+  ASSERT_TRUE(boltdb::DB::Open(path, ropts, &db).ok());
+  {
+    boltdb::Tx tx(db);
+    ASSERT_EQ(4, tx.ID());
+    ASSERT_TRUE(tx.Check([](const std::string&) {}, 2).ok());
+  }
+  delete db;
+  unlink(path.c_str());
+}
+
+// Ensure that a freelist cannot be rebuilt from a damaged tree.
+TEST(DBTest, TestRebuildFreelistCorrupt) {
+  std::string path = tempPath("boltdb-db");
+  boltdb::Options opts = boltdb::Options::Default();
+  boltdb::DB* db = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  delete db;
+
+  // The root is a branch pointing past the end of the file.
+  commitMeta(path, 2, 10, boltdb::kPgidNoFreelist);
+  int page_size = getpagesize();
+  std::vector<char> buf(page_size, 0);
+  auto* p = reinterpret_cast<boltdb::Page*>(buf.data());
+  p->id = 3;
+  writeBranch(p, {"a"}, {50});
+  int fd = open(path.c_str(), O_RDWR);
+  ASSERT_EQ(page_size, pwrite(fd, buf.data(), page_size, 3 * page_size));
+  close(fd);
+
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  boltdb::Tx* tx = nullptr;
+  ASSERT_TRUE(db->Begin(true, &tx).IsCorruption());
+  ASSERT_TRUE(db->Begin(false, &tx).ok());
+  delete tx;
+  delete db;
+  unlink(path.c_str());
+}
+
+// Ensure that a freelist page whose ids do not fit in it fails the load.
+TEST(DBTest, TestLoadFreelistCorrupt) {
+  std::string path = tempPath("boltdb-db");
+  boltdb::Options opts = boltdb::Options::Default();
+  boltdb::DB* db = nullptr;
+  ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+  delete db;
+
+  // A count beyond the page, and an overflowed count beyond the page.
+  commitMeta(path, 2, 8);
+  for (uint64_t first : {uint64_t(0), uint64_t(1) << 40}) {
+    writeFreelist(path, {first});
+    int page_size = getpagesize();
+    std::vector<char> buf(page_size);
+    auto* p = reinterpret_cast<boltdb::Page*>(buf.data());
+    int fd = open(path.c_str(), O_RDWR);
+    ASSERT_EQ(page_size, pread(fd, buf.data(), page_size, 2 * page_size));
+    p->count = first == 0 ? 4000 : 0xFFFF;
+    ASSERT_EQ(page_size, pwrite(fd, buf.data(), page_size, 2 * page_size));
+    close(fd);
+
+    ASSERT_TRUE(boltdb::DB::Open(path, opts, &db).ok());
+    boltdb::Tx* tx = nullptr;
+    ASSERT_TRUE(db->Begin(true, &tx).IsCorruption());
+    ASSERT_TRUE(db->Begin(false, &tx).ok());
+    // Only the bad page is reported, not every free page as leaked.
+    std::vector<std::string> errors;
+    ASSERT_TRUE(
+        tx->Check([&](const std::string& msg) { errors.push_back(msg); }, 2)
+            .IsCorruption());
+    ASSERT_EQ(std::vector<std::string>({"page 2: invalid freelist page"}),
+              errors);
+    delete tx;
+    delete db;
+  }
+  unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
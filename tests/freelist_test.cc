@@ -0,0 +1,155 @@
+#include "boltdb/boltdb.h"
+#include "gtest/gtest.h"
+
+// Ensure that a page is added to a transaction's freelist.
+TEST(FreeListTest, TestFree) {
+  boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+  boltdb::Page p;
+  p.id = 12;
+  p.overflow = 0;
+  f.Free(100, &p);
+  ASSERT_EQ(1, f.PendingCount());
+  ASSERT_EQ(boltdb::pgids_t({12}), f.PendingIDs());
+  ASSERT_TRUE(f.Freed(12));
+}
+
+// Ensure that a page and its overflow is added to a transaction's freelist.
+TEST(FreeListTest, TestFreeOverflow) {
+  boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+  boltdb::Page p;
+  p.id = 12;
+  p.overflow = 3;
+  f.Free(100, &p);
+  ASSERT_EQ(4, f.PendingCount());
+  ASSERT_EQ(boltdb::pgids_t({12, 13, 14, 15}), f.PendingIDs());
+}
+
+// Ensure that a transaction's free pages can be released up to a txid.
+TEST(FreeListTest, TestRelease) {
+  boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+  boltdb::Page p;
+  p.overflow = 1;
+  p.id = 12;
+  f.Free(100, &p);
+  p.id = 9;
+  p.overflow = 0;
+  f.Free(100, &p);
+  p.id = 39;
+  f.Free(102, &p);
+
+  f.Release(100);
+  f.Release(101);
+  ASSERT_EQ(1, f.PendingCount());
+  ASSERT_EQ(3, f.ArrayFreeCount());
+
+  f.Release(102);
+  ASSERT_EQ(0, f.PendingCount());
+  ASSERT_EQ(4, f.ArrayFreeCount());
+  ASSERT_TRUE(f.Freed(39));
+}
+
+// Ensure that rolling back the newest writer drops only its pending pages.
+TEST(FreeListTest, TestRollback) {
+  boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+  boltdb::Page p;
+  p.overflow = 0;
+  p.id = 5;
+  f.Free(100, &p);
+  p.id = 6;
+  f.Free(101, &p);
+
+  f.Rollback(101);
+  ASSERT_EQ(1, f.PendingCount());
+  ASSERT_TRUE(f.Freed(5));
+  ASSERT_FALSE(f.Freed(6));
+}
+
+// Ensure that a batch of pages is freed under one pending entry.
+TEST(FreeListTest, TestFreeBatch) {
+  boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+  f.Free(100, boltdb::pgids_t({7, 3, 4}));
+  f.Free(100, boltdb::pgids_t());
+  ASSERT_EQ(3, f.PendingCount());
+  ASSERT_TRUE(f.Freed(3));
+  ASSERT_FALSE(f.Freed(5));
+
+  f.Rollback(100);
+  ASSERT_EQ(0, f.PendingCount());
+  ASSERT_FALSE(f.Freed(3));
+}
+
+// Ensure that a sorted freelist page is used in place until it is modified.
+TEST(FreeListTest, TestReadInPlace) {
+  std::vector<char> buf(4096, 0);
+  auto* page = reinterpret_cast<boltdb::Page*>(buf.data());
+  page->flags = boltdb::kPageFlagFreeList;
+  page->count = 3;
+  auto* ids = reinterpret_cast<boltdb::pgid_t*>(page->data);
+  ids[0] = 3;
+  ids[1] = 7;
+  ids[2] = 9;
+
+  boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+  f.Read(page, false);
+  ASSERT_EQ(3, f.ArrayFreeCount());
+  ASSERT_TRUE(f.Freed(7));
+  ASSERT_FALSE(f.Freed(8));
+  ASSERT_EQ(boltdb::pgids_t({3, 7, 9}), f.FreeIDs());
+
+  // Releasing a page copies the ids out of the page.
+  boltdb::Page p;
+  p.id = 5;
+  p.overflow = 0;
+  f.Free(100, &p);
+  f.Release(100);
+  ids[1] = 8;
+  ASSERT_EQ(boltdb::pgids_t({3, 5, 7, 9}), f.FreeIDs());
+  ASSERT_TRUE(f.Freed(5));
+  ASSERT_TRUE(f.Freed(7));
+}
+
+// Ensure that pages pending when a freelist page is read stay freed, whether
+// the page is used in place or copied.
+TEST(FreeListTest, TestReadKeepsPending) {
+  std::vector<char> buf(4096, 0);
+  auto* page = reinterpret_cast<boltdb::Page*>(buf.data());
+  page->flags = boltdb::kPageFlagFreeList;
+  page->count = 2;
+  auto* ids = reinterpret_cast<boltdb::pgid_t*>(page->data);
+  ids[0] = 3;
+  ids[1] = 7;
+
+  for (bool copy : {false, true}) {
+    boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+    f.Free(100, boltdb::pgids_t({12}));
+    f.Read(page, copy);
+    ASSERT_TRUE(f.Freed(12)) << copy;
+    ASSERT_TRUE(f.Freed(7)) << copy;
+    ASSERT_FALSE(f.Freed(8)) << copy;
+  }
+}
+
+// Ensure that freeing a page still listed in a freelist page in place is
+// caught as a double free.
+TEST(FreeListTest, TestFreeMappedTwice) {
+  std::vector<char> buf(4096, 0);
+  auto* page = reinterpret_cast<boltdb::Page*>(buf.data());
+  page->flags = boltdb::kPageFlagFreeList;
+  page->count = 2;
+  auto* ids = reinterpret_cast<boltdb::pgid_t*>(page->data);
+  ids[0] = 3;
+  ids[1] = 7;
+
+  boltdb::FreeList f(boltdb::FreeListType::FreeListArray);
+  f.Read(page, false);
+  EXPECT_DEBUG_DEATH(f.Free(100, boltdb::pgids_t({7})), "page already freed");
+  boltdb::Page p;
+  p.id = 3;
+  p.overflow = 0;
+  EXPECT_DEBUG_DEATH(f.Free(100, &p), "page already freed");
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,219 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+
+#include "boltdb/sharded_db.h"
+#include "gtest/gtest.h"
+
+static std::string tempDir() {
+  char buf[] = "/tmp/boltdb-sharded-XXXXXX";
+  return mkdtemp(buf);
+}
+
+static void removeDir(const std::string& dir, int shards) {
+  for (int i = 0; i < shards; i++) {
+    unlink((dir + "/shard-" + std::to_string(i) + ".db").c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+TEST(ShardedDBTest, TestOpenAndSnapshot) {
+  std::string dir = tempDir();
+  boltdb::ShardOptions opts = boltdb::ShardOptions::Default();
+  boltdb::ShardedDB* db = nullptr;
+  ASSERT_TRUE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+  ASSERT_EQ(4, db->Shards());
+
+  boltdb::ShardedSnapshot* snap = nullptr;
+  ASSERT_TRUE(db->BeginSnapshot(&snap).ok());
+  ASSERT_EQ(4, snap->Shards());
+  for (int i = 0; i < snap->Shards(); i++) {
+    ASSERT_EQ(1, snap->Shard(i)->ID());
+  }
+  delete snap;
+
+  delete db;
+  removeDir(dir, 4);
+}
+
+TEST(ShardedDBTest, TestPartition) {
+  std::string dir = tempDir();
+  boltdb::ShardOptions opts = boltdb::ShardOptions::Default();
+  opts.shards = 3;
+  opts.partition = boltdb::ShardPartition::Range;
+  opts.splits = {"g", "p"};
+  boltdb::ShardedDB* db = nullptr;
+  ASSERT_TRUE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+  ASSERT_EQ(0, db->ShardFor("b", "apple"));
+  ASSERT_EQ(1, db->ShardFor("b", "g"));
+  ASSERT_EQ(1, db->ShardFor("b", "orange"));
+  ASSERT_EQ(2, db->ShardFor("b", "zebra"));
+  delete db;
+  removeDir(dir, 3);
+
+  // Hashing by bucket keeps every key of a bucket on one shard.
+  dir = tempDir();
+  opts = boltdb::ShardOptions::Default();
+  ASSERT_TRUE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+  int shard = db->ShardFor("widgets", "a");
+  ASSERT_GE(shard, 0);
+  ASSERT_LT(shard, 4);
+  ASSERT_EQ(shard, db->ShardFor("widgets", "zzz"));
+  delete db;
+  removeDir(dir, 4);
+
+  // Mismatched split count.
+  opts.partition = boltdb::ShardPartition::Range;
+  ASSERT_FALSE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+}
+
+// Ensure that updates of different shards run concurrently.
+TEST(ShardedDBTest, TestParallelUpdate) {
+  std::string dir = tempDir();
+  boltdb::ShardOptions opts = boltdb::ShardOptions::Default();
+  boltdb::ShardedDB* db = nullptr;
+  ASSERT_TRUE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+
+  std::atomic<int> running(0), peak(0);
+  std::vector<std::future<boltdb::Status>> results;
+  for (int i = 0; i < db->Shards(); i++) {
+    boltdb::DB* expected = db->Shard(i);
+    results.push_back(db->UpdateAsync(i, [&, expected](boltdb::DB* shard) {
+      int now = ++running;
+      int prev = peak.load();
+      while (now > prev && !peak.compare_exchange_weak(prev, now)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      --running;
+      return shard == expected ? boltdb::Status::OK()
+                               : boltdb::Status::Invalid();
+    }));
+  }
+  for (auto& r : results) {
+    ASSERT_TRUE(r.get().ok());
+  }
+  ASSERT_GT(peak.load(), 1);
+
+  delete db;
+  removeDir(dir, 4);
+}
+
+// Ensure that updates of unknown shards, or after close, fail instead of
+// touching shard state.
+TEST(ShardedDBTest, TestUpdateInvalidShard) {
+  std::string dir = tempDir();
+  boltdb::ShardOptions opts = boltdb::ShardOptions::Default();
+  boltdb::ShardedDB* db = nullptr;
+  ASSERT_TRUE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+  auto fn = [](boltdb::DB*) { return boltdb::Status::OK(); };
+  ASSERT_TRUE(db->UpdateAsync(-1, fn).get().IsInvalid());
+  ASSERT_TRUE(db->UpdateAsync(db->Shards(), fn).get().IsInvalid());
+
+  ASSERT_TRUE(db->Close().ok());
+  ASSERT_TRUE(db->UpdateAsync(0, fn).get().IsInvalid());
+  ASSERT_TRUE(db->Update("b", "k", fn).IsInvalid());
+  boltdb::ShardedSnapshot* snap = nullptr;
+  ASSERT_TRUE(db->BeginSnapshot(&snap).IsInvalid());
+
+  delete db;
+  removeDir(dir, 4);
+}
+
+// Ensure that updates and snapshots racing Close either complete or fail
+// with Invalid.
+TEST(ShardedDBTest, TestConcurrentClose) {
+  for (int round = 0; round < 20; round++) {
+    std::string dir = tempDir();
+    boltdb::ShardOptions opts = boltdb::ShardOptions::Default();
+    boltdb::ShardedDB* db = nullptr;
+    ASSERT_TRUE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < db->Shards(); i++) {
+      threads.emplace_back([&, i] {
+        for (int n = 0; n < 50; n++) {
+          try {
+            boltdb::Status s = db->UpdateAsync(i, [](boltdb::DB*) {
+                                   return boltdb::Status::OK();
+                                 }).get();
+            failed = failed || !(s.ok() || s.IsInvalid());
+          } catch (const std::future_error&) {
+            failed = true;
+          }
+        }
+      });
+    }
+    threads.emplace_back([&] {
+      for (int n = 0; n < 20; n++) {
+        boltdb::ShardedSnapshot* snap = nullptr;
+        boltdb::Status s = db->BeginSnapshot(&snap);
+        if (s.ok()) {
+          delete snap;
+        }
+        failed = failed || !(s.ok() || s.IsInvalid());
+      }
+    });
+    ASSERT_TRUE(db->Close().ok());
+    for (auto& t : threads) {
+      t.join();
+    }
+    ASSERT_FALSE(failed);
+    delete db;
+    removeDir(dir, 4);
+  }
+}
+
+// Ensure that a snapshot starts while every shard keeps committing.
+TEST(ShardedDBTest, TestSnapshotNotStarved) {
+  std::string dir = tempDir();
+  boltdb::ShardOptions opts = boltdb::ShardOptions::Default();
+  boltdb::ShardedDB* db = nullptr;
+  ASSERT_TRUE(boltdb::ShardedDB::Open(dir, opts, &db).ok());
+
+  // Keep every writer queue full of overlapping updates.
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> producers;
+  for (int i = 0; i < db->Shards(); i++) {
+    producers.emplace_back([&, i] {
+      std::deque<std::future<boltdb::Status>> pending;
+      while (!stop) {
+        while (pending.size() < 8) {
+          pending.push_back(db->UpdateAsync(i, [](boltdb::DB*) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            return boltdb::Status::OK();
+          }));
+        }
+        pending.front().get();
+        pending.pop_front();
+      }
+      for (auto& f : pending) {
+        f.get();
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  auto start = std::chrono::steady_clock::now();
+  boltdb::ShardedSnapshot* snap = nullptr;
+  EXPECT_TRUE(db->BeginSnapshot(&snap).ok());
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(200));
+  delete snap;
+
+  stop = true;
+  for (auto& t : producers) {
+    t.join();
+  }
+  delete db;
+  removeDir(dir, 4);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,78 @@
+#ifndef __BOLTDB_TESTS_TEST_UTIL_H__
+#define __BOLTDB_TESTS_TEST_UTIL_H__
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+
+// Helpers shared by the tests for laying out pages by hand.
+
+// tempPath returns the path of a file that does not exist yet.
+inline std::string tempPath(const std::string& prefix = "boltdb") {
+  std::string tmpl = "/tmp/" + prefix + "-XXXXXX";
+  std::vector<char> buf(tmpl.begin(), tmpl.end());
+  buf.push_back('\0');
+  int fd = mkstemp(buf.data());
+  close(fd);
+  unlink(buf.data());
+  return buf.data();
+}
+
+inline std::string bigEndian64(uint64_t v) {
+  std::string s(8, '\0');
+  for (int i = 7; i >= 0; i--) {
+    s[i] = static_cast<char>(v & 0xff);
+    v >>= 8;
+  }
+  return s;
+}
+
+// bucketValue returns the value of a bucket key whose tree is rooted at root.
+inline std::string bucketValue(boltdb::pgid_t root) {
+  boltdb::dBucket hdr{root, 0};
+  return std::string(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+}
+
+// writeLeaf lays out a leaf page at p holding keys and values and returns
+// the number of bytes used.
+inline size_t writeLeaf(boltdb::Page* p, const std::vector<std::string>& keys,
+                        const std::vector<std::string>& values,
+                        uint32_t flags = 0) {
+  p->flags = boltdb::kPageFlagLeaf;
+  p->count = keys.size();
+  char* kv = p->data + keys.size() * sizeof(boltdb::LeafPageElement);
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto* e = p->GetLeafPageElementAt(i);
+    e->flags = flags;
+    e->pos = kv - reinterpret_cast<char*>(e);
+    e->ksize = keys[i].size();
+    e->vsize = values[i].size();
+    memcpy(kv, keys[i].data(), keys[i].size());
+    memcpy(kv + keys[i].size(), values[i].data(), values[i].size());
+    kv += keys[i].size() + values[i].size();
+  }
+  return kv - reinterpret_cast<char*>(p);
+}
+
+// writeBranch lays out a branch page at p pointing at children.
+inline void writeBranch(boltdb::Page* p, const std::vector<std::string>& keys,
+                        const std::vector<boltdb::pgid_t>& children) {
+  p->flags = boltdb::kPageFlagBranch;
+  p->count = keys.size();
+  char* k = p->data + keys.size() * sizeof(boltdb::BranchPageElement);
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto* e = p->GetBranchPageElementAt(i);
+    e->pos = k - reinterpret_cast<char*>(e);
+    e->ksize = keys[i].size();
+    e->pgid = children[i];
+    memcpy(k, keys[i].data(), keys[i].size());
+    k += keys[i].size();
+  }
+}
+
+#endif
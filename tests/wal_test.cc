@@ -0,0 +1,141 @@
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "boltdb/boltdb.h"
+#include "gtest/gtest.h"
+#include "tests/test_util.h"
+#include "wal.h"
+
+using boltdb::WalOp;
+using boltdb::WalRecord;
+using boltdb::WriteAheadLog;
+
+TEST(WalTest, TestAppendAndGet) {
+  std::string path = tempPath("boltdb-wal");
+  WriteAheadLog* wal = nullptr;
+  ASSERT_TRUE(WriteAheadLog::Open(path, &wal).ok());
+
+  ASSERT_TRUE(wal->Append(2, {{WalOp::Put, "widgets", "foo", "bar"}}).ok());
+  ASSERT_TRUE(wal->Append(3, {{WalOp::Delete, "widgets", "foo", ""}}).ok());
+
+  std::string value;
+  bool deleted = false;
+  ASSERT_TRUE(wal->Get("widgets", "foo", 2, &value, &deleted).ok());
+  ASSERT_FALSE(deleted);
+  ASSERT_EQ("bar", value);
+  ASSERT_TRUE(wal->Get("widgets", "foo", 3, &value, &deleted).ok());
+  ASSERT_TRUE(deleted);
+  ASSERT_TRUE(wal->Get("widgets", "foo", 1, &value, &deleted).IsNotFound());
+  ASSERT_TRUE(wal->Get("widgets", "baz", 3, &value, &deleted).IsNotFound());
+
+  delete wal;
+  unlink(path.c_str());
+}
+
+// Ensure that batches are only accepted in txid order, which checkpoints
+// rely on to tell folded batches from newer ones.
+TEST(WalTest, TestAppendOutOfOrder) {
+  std::string path = tempPath("boltdb-wal");
+  WriteAheadLog* wal = nullptr;
+  ASSERT_TRUE(WriteAheadLog::Open(path, &wal).ok());
+  ASSERT_TRUE(wal->Append(3, {{WalOp::Put, "widgets", "foo", "bar"}}).ok());
+  EXPECT_DEBUG_DEATH(wal->Append(2, {{WalOp::Put, "widgets", "foo", "baz"}}),
+                     "txids must strictly increase");
+  EXPECT_DEBUG_DEATH(wal->Append(3, {{WalOp::Put, "widgets", "foo", "baz"}}),
+                     "txids must strictly increase");
+  ASSERT_EQ(3, wal->LastTxid());
+
+  delete wal;
+  unlink(path.c_str());
+}
+
+// Ensure that a reopened log replays complete batches and drops a torn tail.
+TEST(WalTest, TestReplayTornTail) {
+  std::string path = tempPath("boltdb-wal");
+  WriteAheadLog* wal = nullptr;
+  ASSERT_TRUE(WriteAheadLog::Open(path, &wal).ok());
+  ASSERT_TRUE(wal->Append(2, {{WalOp::Put, "widgets", "foo", "bar"}}).ok());
+  size_t good = wal->Size();
+  ASSERT_TRUE(wal->Append(3, {{WalOp::Put, "widgets", "foo", "baz"}}).ok());
+  delete wal;
+  ASSERT_EQ(0, truncate(path.c_str(), good + 5));
+
+  ASSERT_TRUE(WriteAheadLog::Open(path, &wal).ok());
+  ASSERT_EQ(good, wal->Size());
+  ASSERT_EQ(2, wal->LastTxid());
+  std::string value;
+  bool deleted = false;
+  ASSERT_TRUE(wal->Get("widgets", "foo", 3, &value, &deleted).ok());
+  ASSERT_EQ("bar", value);
+
+  delete wal;
+  unlink(path.c_str());
+}
+
+TEST(WalTest, TestCheckpoint) {
+  std::string path = tempPath("boltdb-wal");
+  WriteAheadLog* wal = nullptr;
+  ASSERT_TRUE(WriteAheadLog::Open(path, &wal).ok());
+  ASSERT_TRUE(wal->Append(2, {{WalOp::Put, "widgets", "a", "1"},
+                              {WalOp::Put, "widgets", "b", "2"}})
+                  .ok());
+  ASSERT_TRUE(wal->Append(3, {{WalOp::Put, "widgets", "c", "3"}}).ok());
+
+  int applied = 0;
+  ASSERT_TRUE(wal->Checkpoint([&](boltdb::txid_t,
+                                  const std::vector<WalRecord>& records) {
+                   applied += records.size();
+                   return boltdb::Status::OK();
+                 })
+                  .ok());
+  ASSERT_EQ(3, applied);
+  ASSERT_EQ(0, wal->Size());
+
+  std::string value;
+  bool deleted = false;
+  ASSERT_TRUE(wal->Get("widgets", "a", 3, &value, &deleted).IsNotFound());
+
+  delete wal;
+  unlink(path.c_str());
+}
+
+// Ensure that manual checkpoints racing the background checkpointer fold
+// every batch exactly once.
+TEST(WalTest, TestConcurrentCheckpoint) {
+  std::string path = tempPath("boltdb-wal");
+  WriteAheadLog* wal = nullptr;
+  ASSERT_TRUE(WriteAheadLog::Open(path, &wal).ok());
+
+  std::mutex mu;
+  std::map<boltdb::txid_t, int> applied;
+  auto apply = [&](boltdb::txid_t txid, const std::vector<WalRecord>&) {
+    // Widen the window in which both checkpoints hold the same batches.
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    std::lock_guard<std::mutex> lock(mu);
+    applied[txid]++;
+    return boltdb::Status::OK();
+  };
+  wal->StartCheckpointer(apply, 1);
+  for (boltdb::txid_t txid = 2; txid < 200; txid++) {
+    ASSERT_TRUE(wal->Append(txid, {{WalOp::Put, "widgets", "k", "v"}}).ok());
+    ASSERT_TRUE(wal->Checkpoint(apply).ok());
+  }
+  wal->StopCheckpointer();
+  ASSERT_TRUE(wal->Checkpoint(apply).ok());
+
+  ASSERT_EQ(198, applied.size());
+  for (const auto& kv : applied) {
+    ASSERT_EQ(1, kv.second) << kv.first;
+  }
+  delete wal;
+  unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,7 @@
+#include <cstring>
+
 #include "boltdb/boltdb.h"
+#include "buffer_pool.h"
 
 namespace boltdb {
 
@@ -34,8 +37,176 @@ TxStats TxStats::Sub(const TxStats& other) {
   return diff;
 }
 
+Tx::Tx(DB* db, bool writable)
+    : writable_(writable),
+      managed_(false),
+      db_(db),
+      meta_(new Meta),
+      stats_(),
+      write_flag_(0) {
+  // Only one writer is allowed at a time.
+  if (this->writable_) {
+    this->db_->rwlock_.lock();
+  }
+
+  // Obtain a read-only lock on the mmap. When the mmap is remapped it will
+  // obtain a write lock so all transactions must be closed before it can be
+  // remapped.
+  this->db_->mmaplock_.lock_shared();
+
+  // Copy the meta page since it can be changed by the writer.
+  this->db_->meta()->Copy(this->meta_);
+
+  // Increment the transaction id for writers.
+  if (this->writable_) {
+    this->meta_->txid += 1;
+  }
+}
+
+Tx::~Tx() {
+  for (auto& kv : this->buckets_) {
+    delete kv.second;
+  }
+  for (auto& kv : this->pinned_) {
+    this->db_->pool_->Unpin(kv.first);
+  }
+  for (auto& kv : this->pages_) {
+    delete[] reinterpret_cast<char*>(kv.second);
+  }
+  // Nothing is committed, so the pages freed by a writer go back.
+  if (this->writable_) {
+    this->db_->freelist_->Rollback(this->meta_->txid);
+  }
+  this->db_->mmaplock_.unlock_shared();
+  if (this->writable_) {
+    this->db_->rwlock_.unlock();
+  }
+  delete this->meta_;
+}
+
+Bucket* Tx::GetBucket(const std::string& name) {
+  auto it = this->buckets_.find(name);
+  if (it != this->buckets_.end()) {
+    return it->second;
+  }
+
+  // Look the name up in the root bucket.
+  Bucket root(this, this->meta_->root, nullptr, nullptr);
+  Page* p = root.rootPage();
+  while (p != nullptr && (p->flags & kPageFlagBranch)) {
+    uint16_t index = root.childIndex(p, name);
+    p = this->page(p->GetBranchPageElementAt(index)->pgid);
+  }
+  if (p == nullptr) {
+    return nullptr;
+  }
+  bool exact = false;
+  uint16_t index = p->SearchLeaf(name, BytewiseComparator(), &exact);
+  if (!exact) {
+    return nullptr;
+  }
+  LeafPageElement* e = p->GetLeafPageElementAt(index);
+  Slice value = e->value();
+  if (!(e->flags & kBucketLeafFlag) || value.size() < kBucketHeaderSize) {
+    return nullptr;
+  }
+
+  // Inline buckets keep their single leaf page right after the header.
+  dBucket hdr;
+  memcpy(&hdr, value.data(), sizeof(hdr));
+  Page* inline_page = nullptr;
+  if (hdr.root == 0) {
+    inline_page = reinterpret_cast<Page*>(
+        const_cast<char*>(value.data() + kBucketHeaderSize));
+  }
+
+  const Comparator* cmp = nullptr;
+  auto cit = this->db_->comparators_.find(name);
+  if (cit != this->db_->comparators_.end()) {
+    cmp = cit->second;
+  }
+  auto* b = new Bucket(this, hdr, inline_page, cmp);
+  b->name_ = name;
+  this->buckets_[name] = b;
+  return b;
+}
+
 int64_t Tx::Size() const {
     return meta_->pgid * (db_->page_size_);
 }
 
-}  // namespace boltdb
\ No newline at end of file
+Page* Tx::page(pgid_t id) {
+  // Check the dirty pages first.
+  auto it = this->pages_.find(id);
+  if (it != this->pages_.end()) {
+    return it->second;
+  }
+  // With the buffer pool backend, pin the page until the tx closes.
+  if (this->db_->pool_ != nullptr) {
+    // Checker workers call page() concurrently. The read itself happens
+    // outside the lock; if another worker pinned the page meanwhile, the
+    // extra pin is dropped.
+    {
+      std::lock_guard<std::mutex> lock(this->pinned_mu_);
+      auto pit = this->pinned_.find(id);
+      if (pit != this->pinned_.end()) {
+        return pit->second;
+      }
+    }
+    Page* p = this->db_->pool_->Pin(id);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(this->pinned_mu_);
+    auto res = this->pinned_.emplace(id, p);
+    if (!res.second) {
+      this->db_->pool_->Unpin(id);
+    }
+    return res.first->second;
+  }
+
+  // Otherwise return directly from the mmap.
+  return this->db_->page(id);
+}
+
+Page* Tx::acquire(pgid_t id) {
+  auto it = this->pages_.find(id);
+  if (it != this->pages_.end()) {
+    return it->second;
+  }
+  if (this->db_->pool_ != nullptr) {
+    return this->db_->pool_->Pin(id);
+  }
+  return this->db_->page(id);
+}
+
+void Tx::release(pgid_t id) {
+  if (this->db_->pool_ != nullptr && this->pages_.count(id) == 0) {
+    this->db_->pool_->Unpin(id);
+  }
+}
+
+void Tx::prefetch(pgid_t id) {
+  if (this->pages_.count(id) == 0) {
+    this->db_->adviseWillNeed(id, 1);
+  }
+}
+
+void Tx::dirty(pgid_t id, char* buf) {
+  Page*& slot = this->pages_[id];
+  delete[] reinterpret_cast<char*>(slot);
+  slot = reinterpret_cast<Page*>(buf);
+}
+
+void Tx::free(const pgids_t& ids) {
+  for (pgid_t id : ids) {
+    auto it = this->pages_.find(id);
+    if (it != this->pages_.end()) {
+      delete[] reinterpret_cast<char*>(it->second);
+      this->pages_.erase(it);
+    }
+  }
+  this->db_->freelist_->Free(this->meta_->txid, ids);
+}
+
+}  // namespace boltdb
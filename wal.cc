@@ -0,0 +1,359 @@
+#include "wal.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "boltdb/fsync.h"
+#include "hash.h"
+
+namespace boltdb {
+
+static constexpr size_t kBatchHeaderSize = 4 + 8 + 8;
+static constexpr size_t kRecordHeaderSize = 1 + 4 + 4 + 4;
+
+template <typename T>
+static void putFixed(std::string* dst, T v) {
+  dst->append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+template <typename T>
+static T getFixed(const char* src) {
+  T v;
+  memcpy(&v, src, sizeof(v));
+  return v;
+}
+
+static std::string encodeBatch(txid_t txid,
+                               const std::vector<WalRecord>& records) {
+  std::string payload;
+  for (const auto& r : records) {
+    putFixed<uint8_t>(&payload, static_cast<uint8_t>(r.op));
+    putFixed<uint32_t>(&payload, r.bucket.size());
+    putFixed<uint32_t>(&payload, r.key.size());
+    putFixed<uint32_t>(&payload, r.value.size());
+    payload.append(r.bucket).append(r.key).append(r.value);
+  }
+
+  std::string batch;
+  batch.reserve(kBatchHeaderSize + payload.size());
+  putFixed<uint32_t>(&batch, payload.size());
+  putFixed<uint64_t>(&batch, txid);
+  putFixed<uint64_t>(&batch, Fnv1a64(payload.data(), payload.size()));
+  batch.append(payload);
+  return batch;
+}
+
+// syncDir makes a rename inside the directory holding path durable.
+static Status syncDir(const std::string& path) {
+  size_t slash = path.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+  if (dir.empty()) {
+    dir = "/";
+  }
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return Status::IOError();
+  }
+  Status s = fsync(fd);
+  ::close(fd);
+  return s;
+}
+
+static bool decodeRecords(const char* p, size_t n,
+                          std::vector<WalRecord>* records) {
+  const char* end = p + n;
+  while (p < end) {
+    if (size_t(end - p) < kRecordHeaderSize) {
+      return false;
+    }
+    WalRecord r;
+    r.op = static_cast<WalOp>(getFixed<uint8_t>(p));
+    uint32_t bsize = getFixed<uint32_t>(p + 1);
+    uint32_t ksize = getFixed<uint32_t>(p + 5);
+    uint32_t vsize = getFixed<uint32_t>(p + 9);
+    p += kRecordHeaderSize;
+    if (size_t(end - p) < uint64_t(bsize) + ksize + vsize) {
+      return false;
+    }
+    r.bucket.assign(p, bsize);
+    r.key.assign(p + bsize, ksize);
+    r.value.assign(p + bsize + ksize, vsize);
+    p += bsize + ksize + vsize;
+    records->push_back(std::move(r));
+  }
+  return true;
+}
+
+static Status writeAll(int fd, const std::string& buf, off_t offset) {
+  size_t written = 0;
+  while (written < buf.size()) {
+    ssize_t n = ::pwrite(fd, buf.data() + written, buf.size() - written,
+                         offset + written);
+    if (n < 0) {
+      return Status::IOError();
+    }
+    written += n;
+  }
+  return Status::OK();
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& path, int fd)
+    : path_(path),
+      fd_(fd),
+      size_(0),
+      last_txid_(0),
+      stopping_(false),
+      threshold_(0) {}
+
+WriteAheadLog::~WriteAheadLog() {
+  this->StopCheckpointer();
+  ::close(this->fd_);
+}
+
+Status WriteAheadLog::Open(const std::string& path, WriteAheadLog** walptr) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0666);
+  if (fd < 0) {
+    return Status::IOError();
+  }
+  auto* wal = new WriteAheadLog(path, fd);
+  Status s = wal->replay();
+  if (!s.ok()) {
+    delete wal;
+    return s;
+  }
+  *walptr = wal;
+  return Status::OK();
+}
+
+Status WriteAheadLog::replay() {
+  struct stat st;
+  if (::fstat(this->fd_, &st) != 0) {
+    return Status::IOError();
+  }
+  std::string buf(st.st_size, '\0');
+  if (::pread(this->fd_, &buf[0], buf.size(), 0) != ssize_t(buf.size())) {
+    return Status::IOError();
+  }
+
+  size_t off = 0;
+  while (buf.size() - off >= kBatchHeaderSize) {
+    const char* p = buf.data() + off;
+    uint32_t size = getFixed<uint32_t>(p);
+    txid_t txid = getFixed<uint64_t>(p + 4);
+    uint64_t checksum = getFixed<uint64_t>(p + 12);
+    if (buf.size() - off - kBatchHeaderSize < size) {
+      break;
+    }
+    const char* payload = p + kBatchHeaderSize;
+    if (Fnv1a64(payload, size) != checksum) {
+      break;
+    }
+    std::vector<WalRecord> records;
+    if (!decodeRecords(payload, size, &records)) {
+      break;
+    }
+    for (const auto& r : records) {
+      this->overlay_[Key(r.bucket, r.key)].push_back(
+          Version{txid, r.op == WalOp::Delete, r.value});
+    }
+    this->batches_.emplace_back(txid, std::move(records));
+    this->last_txid_ = txid;
+    off += kBatchHeaderSize + size;
+  }
+
+  // Drop a torn batch left behind by a crash in the middle of Append.
+  if (off != buf.size() && ::ftruncate(this->fd_, off) != 0) {
+    return Status::IOError();
+  }
+  this->size_ = off;
+  return Status::OK();
+}
+
+Status WriteAheadLog::Append(txid_t txid,
+                             const std::vector<WalRecord>& records) {
+  std::string batch = encodeBatch(txid, records);
+
+  std::unique_lock<std::mutex> lock(this->mu_);
+  // Checkpoint tells folded batches from newer ones by txid alone.
+  assert(txid > this->last_txid_ && "txids must strictly increase");
+  if (txid <= this->last_txid_) {
+    return Status::Invalid();
+  }
+  Status s = writeAll(this->fd_, batch, this->size_);
+  if (s.ok()) {
+    s = fsync(this->fd_);
+  }
+  if (!s.ok()) {
+    // Cut off whatever part of the batch reached the file.
+    (void)::ftruncate(this->fd_, this->size_);
+    return s;
+  }
+
+  this->size_ += batch.size();
+  this->last_txid_ = txid;
+  for (const auto& r : records) {
+    this->overlay_[Key(r.bucket, r.key)].push_back(
+        Version{txid, r.op == WalOp::Delete, r.value});
+  }
+  this->batches_.emplace_back(txid, records);
+  bool wake = this->threshold_ != 0 && this->size_ >= this->threshold_;
+  lock.unlock();
+
+  if (wake) {
+    this->cv_.notify_one();
+  }
+  return Status::OK();
+}
+
+Status WriteAheadLog::Get(const std::string& bucket, const std::string& key,
+                          txid_t txid, std::string* value,
+                          bool* deleted) const {
+  std::lock_guard<std::mutex> lock(this->mu_);
+  auto it = this->overlay_.find(Key(bucket, key));
+  if (it == this->overlay_.end()) {
+    return Status::NotFound();
+  }
+  // Versions are appended in txid order; take the newest visible one.
+  const auto& versions = it->second;
+  for (auto v = versions.rbegin(); v != versions.rend(); ++v) {
+    if (v->txid <= txid) {
+      *deleted = v->deleted;
+      if (!v->deleted) {
+        *value = v->value;
+      }
+      return Status::OK();
+    }
+  }
+  return Status::NotFound();
+}
+
+// Checkpoint must not run while read transactions that started before the
+// folded batches are still open: they see the old tree and would lose the
+// overlay entries dropped here.
+Status WriteAheadLog::Checkpoint(const apply_fn_t& apply) {
+  // A manual checkpoint and the background checkpointer must not fold the
+  // same batches twice.
+  std::lock_guard<std::mutex> checkpoint_lock(this->checkpoint_mu_);
+  std::vector<std::pair<txid_t, std::vector<WalRecord>>> batches;
+  {
+    std::lock_guard<std::mutex> lock(this->mu_);
+    batches = this->batches_;
+  }
+
+  for (const auto& b : batches) {
+    Status s = apply(b.first, b.second);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(this->mu_);
+  // Batches appended while the fold was running stay in the log. They are
+  // written to a fresh file which then replaces the log, so a crash here
+  // never loses a batch that has not been folded yet.
+  txid_t folded = batches.empty() ? 0 : batches.back().first;
+  auto unfolded = std::find_if(
+      this->batches_.begin(), this->batches_.end(),
+      [folded](const std::pair<txid_t, std::vector<WalRecord>>& b) {
+        return b.first > folded;
+      });
+  std::string rest;
+  for (auto it = unfolded; it != this->batches_.end(); ++it) {
+    rest.append(encodeBatch(it->first, it->second));
+  }
+  std::string tmp = this->path_ + ".tmp";
+  int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    return Status::IOError();
+  }
+  Status s = writeAll(fd, rest, 0);
+  if (s.ok()) {
+    s = fsync(fd);
+  }
+  if (s.ok() && ::rename(tmp.c_str(), this->path_.c_str()) != 0) {
+    s = Status::IOError();
+  }
+  if (!s.ok()) {
+    ::close(fd);
+    ::unlink(tmp.c_str());
+    return s;
+  }
+  // The rename is only durable once the directory entry is synced. Both
+  // files hold every unfolded batch, so a failed sync is reported but the
+  // replacement still goes ahead.
+  Status synced = syncDir(this->path_);
+  ::close(this->fd_);
+  this->fd_ = fd;
+  this->size_ = rest.size();
+
+  for (auto it = this->overlay_.begin(); it != this->overlay_.end();) {
+    auto& versions = it->second;
+    while (!versions.empty() && versions.front().txid <= folded) {
+      versions.erase(versions.begin());
+    }
+    it = versions.empty() ? this->overlay_.erase(it) : std::next(it);
+  }
+  this->batches_.erase(this->batches_.begin(), unfolded);
+  return synced;
+}
+
+void WriteAheadLog::StartCheckpointer(apply_fn_t apply, size_t threshold) {
+  std::lock_guard<std::mutex> lock(this->mu_);
+  if (this->checkpointer_.joinable()) {
+    return;
+  }
+  this->apply_ = std::move(apply);
+  this->threshold_ = threshold;
+  this->stopping_ = false;
+  this->checkpointer_ = std::thread(&WriteAheadLog::checkpointLoop, this);
+}
+
+void WriteAheadLog::StopCheckpointer() {
+  {
+    std::lock_guard<std::mutex> lock(this->mu_);
+    if (!this->checkpointer_.joinable()) {
+      return;
+    }
+    this->stopping_ = true;
+    this->threshold_ = 0;
+  }
+  this->cv_.notify_one();
+  this->checkpointer_.join();
+}
+
+void WriteAheadLog::checkpointLoop() {
+  std::unique_lock<std::mutex> lock(this->mu_);
+  size_t failed_at = 0;
+  while (true) {
+    this->cv_.wait(lock, [this, &failed_at] {
+      return this->stopping_ ||
+             (this->threshold_ != 0 && this->size_ >= this->threshold_ &&
+              this->size_ != failed_at);
+    });
+    if (this->stopping_) {
+      return;
+    }
+    lock.unlock();
+    // A failed fold leaves the log intact; retry once it grows again.
+    Status s = this->Checkpoint(this->apply_);
+    lock.lock();
+    failed_at = s.ok() ? 0 : this->size_;
+  }
+}
+
+size_t WriteAheadLog::Size() const {
+  std::lock_guard<std::mutex> lock(this->mu_);
+  return this->size_;
+}
+
+txid_t WriteAheadLog::LastTxid() const {
+  std::lock_guard<std::mutex> lock(this->mu_);
+  return this->last_txid_;
+}
+
+}  // namespace boltdb
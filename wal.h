@@ -0,0 +1,115 @@
+#ifndef __BOLTDB_WAL_H__
+#define __BOLTDB_WAL_H__
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "boltdb/boltdb.h"
+
+namespace boltdb {
+
+enum class WalOp : uint8_t {
+  Put = 1,
+  Delete = 2,
+};
+
+// WalRecord is a single logical key update inside a bucket.
+struct WalRecord {
+  WalOp op;
+  std::string bucket;
+  std::string key;
+  std::string value;
+};
+
+/**
+ * @brief WriteAheadLog is a sidecar log of committed txs. Each tx is appended
+ * as one batch and synced once:
+ * ---------------------------------------------------------------
+ * | size(uint32) | txid(uint64) | checksum(uint64) | records... |
+ * ---------------------------------------------------------------
+ * -----------------------------------------------------------------------
+ * | op(uint8) | bsize(uint32) | ksize(uint32) | vsize(uint32) |b|k|v|
+ * -----------------------------------------------------------------------
+ * A torn batch at the tail is detected by its size or checksum and cut off
+ * when the log is opened.
+ *
+ * Every logged update is also kept in an in-memory overlay so readers can
+ * merge it with the mmap'd tree, until a checkpoint folds the log into the
+ * tree and truncates it.
+ *
+ * Readers merge the overlay once the log is attached with DB::AttachWal.
+ * Commits do not append to it yet, so no DB option enables it.
+ */
+class WriteAheadLog : public noncopyable {
+ public:
+  using apply_fn_t =
+      std::function<Status(txid_t, const std::vector<WalRecord>&)>;
+
+  ~WriteAheadLog();
+
+  // Open opens (or creates) the log at path and replays it into the overlay.
+  static Status Open(const std::string& path, WriteAheadLog** walptr);
+
+  // Append logs the records of a committed tx as one batch with one fsync.
+  // txids must strictly increase; an older one is rejected with Invalid.
+  Status Append(txid_t txid, const std::vector<WalRecord>& records);
+
+  // Get looks a key up in the overlay as seen by a reader at txid.
+  // Returns NotFound if the log has no opinion on the key, in which case the
+  // reader must fall back to the tree. A logged delete sets *deleted.
+  Status Get(const std::string& bucket, const std::string& key, txid_t txid,
+             std::string* value, bool* deleted) const;
+
+  // Checkpoint hands every logged batch to apply in txid order, then
+  // truncates the log and drops the overlay.
+  Status Checkpoint(const apply_fn_t& apply);
+
+  // StartCheckpointer runs Checkpoint in the background whenever the log
+  // grows past threshold bytes.
+  void StartCheckpointer(apply_fn_t apply, size_t threshold);
+  void StopCheckpointer();
+
+  // Size returns the current size of the log file in bytes.
+  size_t Size() const;
+  // LastTxid returns the txid of the newest logged batch.
+  txid_t LastTxid() const;
+
+ private:
+  WriteAheadLog(const std::string& path, int fd);
+  Status replay();
+  void checkpointLoop();
+
+ private:
+  struct Version {
+    txid_t txid;
+    bool deleted;
+    std::string value;
+  };
+  using Key = std::pair<std::string, std::string>;
+
+  std::string path_;
+  int fd_;
+  size_t size_;
+  txid_t last_txid_;
+  std::vector<std::pair<txid_t, std::vector<WalRecord>>> batches_;
+  std::map<Key, std::vector<Version>> overlay_;
+  mutable std::mutex mu_;
+  // Serializes checkpoints; taken before mu_.
+  std::mutex checkpoint_mu_;
+
+  std::thread checkpointer_;
+  std::condition_variable cv_;
+  bool stopping_;
+  size_t threshold_;
+  apply_fn_t apply_;
+};
+
+}  // namespace boltdb
+
+#endif